@@ -1,6 +1,10 @@
 #ifndef LIPH_A_STAR_SEARCH_HPP
 #define LIPH_A_STAR_SEARCH_HPP
 
+#include "../parallel_for/parallel_for.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <deque>
 #include <functional>
 #include <iterator>
@@ -8,6 +12,7 @@
 #include <queue>
 #include <set>
 #include <stdexcept>
+#include <thread>
 #include <type_traits>
 #include <unordered_set>
 #include <utility>
@@ -219,12 +224,111 @@ template<typename T>
 using container_t = container_type<T>::type;
 
 
+// remembers estimated_remaining_cost per state. only states which can be hashed can be cached;
+// for everything else the cache is a no-op.
+template<typename State, typename Cost>
+class heuristic_cache {
+public:
+    explicit heuristic_cache(std::size_t) {}
+
+    template<typename Func>
+    Cost get(const State &state, Func &&compute) { return compute(state); }
+
+    void clear() {}
+};
+
+// direct-mapped: each state hashes to exactly one slot and a colliding state simply replaces
+// whatever was there, so the memory used never exceeds the capacity given at construction.
+template<typename State, typename Cost>
+    requires UnorderedSetStorable<State>
+class heuristic_cache<State, Cost> {
+public:
+    explicit heuristic_cache(std::size_t capacity) : slots(capacity) {}
+
+    template<typename Func>
+    Cost get(const State &state, Func &&compute) {
+        if(slots.empty())
+            return compute(state);
+
+        std::optional<std::pair<State, Cost>> &slot = slots[std::hash<State>{}(state) % slots.size()];
+        if(slot && slot->first == state)
+            return slot->second;
+
+        Cost cost = compute(state);
+        slot.emplace(state, cost);
+        return cost;
+    }
+
+    void clear() {
+        for(auto &slot : slots)
+            slot.reset();
+    }
+
+private:
+    std::vector<std::optional<std::pair<State, Cost>>> slots;
+};
+
 
+
+// calls the SearchProblemState member functions, passing global_state to those which take it
 template<typename GlobalState, SearchProblemState<GlobalState> State>
-class searcher {
+class problem {
 public:
     using cost_type = cost_t<GlobalState, State>;
 
+    problem(GlobalState &global_state) : global_state(global_state) {}
+
+protected:
+    cost_type accrued_cost(const cost_type &prev_cost, const HasAdditionalCost &current_state) {
+        return prev_cost + current_state.additional_cost();
+    }
+
+    cost_type accrued_cost(const cost_type &, const HasAccruedCost &state) {
+        return state.accrued_cost();
+    }
+
+    cost_type estimated_remaining_cost(const HasEstimatedRemainingCost &state) {
+        return state.estimated_remaining_cost();
+    }
+
+    auto get_next_states(const HasNextStates &state) { return state.next_states(); }
+
+    bool done(const HasDone &state) { return state.done(); }
+
+
+    cost_type accrued_cost(const cost_type &prev_cost, const HasAdditionalCostWithParam<GlobalState> &current_state) {
+        return prev_cost + current_state.additional_cost(global_state);
+    }
+
+    cost_type accrued_cost(const cost_type &, const HasAccruedCostWithParam<GlobalState> &state) {
+        return state.accrued_cost(global_state);
+    }
+
+    cost_type estimated_remaining_cost(const HasEstimatedRemainingCostWithParam<GlobalState> &state) {
+        return state.estimated_remaining_cost(global_state);
+    }
+
+    auto get_next_states(const HasNextStatesWithParam<GlobalState> &state) {
+        return state.next_states(global_state);
+    }
+
+    bool done(const HasDoneWithParam<GlobalState> &state) { return state.done(global_state); }
+
+    GlobalState &global_state;
+};
+
+
+template<typename GlobalState, SearchProblemState<GlobalState> State>
+class searcher : problem<GlobalState, State> {
+    using base = problem<GlobalState, State>;
+    using base::accrued_cost;
+    using base::estimated_remaining_cost;
+    using base::get_next_states;
+    using base::done;
+
+public:
+    using cost_type = typename base::cost_type;
+
     struct link_type {
         using state_type = State;
         State state;
@@ -248,8 +352,23 @@ private:
         }
     };
 
+    // std::priority_queue has no clear(), and reassigning it would throw away the capacity
+    struct next_link_queue : std::priority_queue<next_link_type, std::vector<next_link_type>, std::greater<next_link_type>> {
+        void clear() { this->c.clear(); }
+    };
+
 public:
-    searcher(GlobalState &global_state) : global_state(global_state) {}
+    searcher(GlobalState &global_state, std::size_t heuristic_cache_size = 0) 
+        : base(global_state), heuristics(heuristic_cache_size) {}
+
+    // forget the previous search but keep the allocated storage around for the next one.
+    // the heuristic cache is kept as well, since it only depends upon the states and global_state
+    void reset() {
+        states.clear();
+        next_states.clear();
+    }
+
+    void clear_heuristic_cache() { heuristics.clear(); }
 
     const link_type *run(const State &initial_state) {
         const link_type *new_state = add_state(states.end(), link_type{initial_state, cost_type{}, nullptr});
@@ -271,13 +390,16 @@ public:
         for(auto &next : get_next_states(prev_link->state)) {
             cost_type accrued = accrued_cost(prev_cost, next);
             
+            // reaching a state again at the same cost would only expand it again
             iterator it = existing_state(next);
-            if(it != states.end() && it->accrued_cost < accrued)
+            if(it != states.end() && !(accrued < it->accrued_cost))
                 continue;
 
             const link_type *new_state = add_state(it, link_type{next, accrued, prev_link});
             
-            cost_type estimated = accrued + estimated_remaining_cost(next);
+            cost_type estimated = accrued + heuristics.get(next, [this](const State &state) { 
+                return estimated_remaining_cost(state); 
+            });
 
             if(estimated < accrued)
                 throw std::logic_error("estimated_remaining_cost cannot be negative");
@@ -288,43 +410,6 @@ public:
     }
 
 private:
-    cost_type accrued_cost(const cost_type &prev_cost, const HasAdditionalCost &current_state) {
-        return prev_cost + current_state.additional_cost();
-    }
-
-    cost_type accrued_cost(const cost_type &, const HasAccruedCost &state) {
-        return state.accrued_cost();
-    }
-
-    cost_type estimated_remaining_cost(const HasEstimatedRemainingCost &state) {
-        return state.estimated_remaining_cost();
-    }
-
-    auto get_next_states(const HasNextStates &state) { return state.next_states(); }
-
-    bool done(const HasDone &state) { return state.done(); }
-
-
-    cost_type accrued_cost(const cost_type &prev_cost, const HasAdditionalCostWithParam<GlobalState> &current_state) {
-        return prev_cost + current_state.additional_cost(global_state);
-    }
-
-    cost_type accrued_cost(const cost_type &, const HasAccruedCostWithParam<GlobalState> &state) {
-        return state.accrued_cost(global_state);
-    }
-
-    cost_type estimated_remaining_cost(const HasEstimatedRemainingCostWithParam<GlobalState> &state) {
-        return state.estimated_remaining_cost(global_state);
-    }
-
-    auto get_next_states(const HasNextStatesWithParam<GlobalState> &state) {
-        return state.next_states(global_state);
-    }
-
-    bool done(const HasDoneWithParam<GlobalState> &state) { return state.done(global_state); }
-
-
-
     const link_type *add_state(iterator existing_it, link_type &&state) requires is_ordered_container {
         if(existing_it == states.end())
             return &*states.insert(std::move(state)).first;
@@ -349,12 +434,23 @@ private:
     }
 
 
-    GlobalState &global_state;
     container_type states;
-    std::priority_queue<next_link_type, std::vector<next_link_type>, std::greater<next_link_type>> next_states; 
+    next_link_queue next_states; 
+    heuristic_cache<State, cost_type> heuristics;
 };
 
 
+template<typename Link>
+std::deque<typename Link::state_type> make_path(const Link *link) {
+    std::deque<typename Link::state_type> states;
+    while(link) {
+        states.push_front(link->state);
+        link = link->prev;
+    }
+    return states;
+}
+
+
 }  // namespace detail
 
 
@@ -362,18 +458,50 @@ private:
 template<typename GlobalState, SearchProblemState<GlobalState> State>
 std::deque<State> a_star_search(const State &initial_state, GlobalState &global_state) {
     detail::searcher<GlobalState, State> s(global_state);
-    const typename detail::searcher<GlobalState, State>::link_type *link = s.run(initial_state);
+    return detail::make_path(s.run(initial_state));
+}
 
-    if(!link)
-        return {};
 
-    std::deque<State> states;
-    while(link) {
-        states.push_front(link->state);
-        link = link->prev;
+// Runs many searches against the same global_state, reusing the storage of the previous search
+// instead of reallocating it for every query. If heuristic_cache_size is non-zero (and State is hashable),
+// estimated_remaining_cost is remembered for up to that many states across searches, so 
+// clear_heuristic_cache() must be called if anything in global_state affecting it changes.
+template<typename GlobalState, SearchProblemState<GlobalState> State>
+class a_star_session {
+public:
+    explicit a_star_session(GlobalState &global_state, std::size_t heuristic_cache_size = 0) 
+        : s(global_state, heuristic_cache_size) {}
+
+    std::deque<State> search(const State &initial_state) {
+        s.reset();
+        return detail::make_path(s.run(initial_state));
     }
 
-    return states;
+    void clear_heuristic_cache() { s.clear_heuristic_cache(); }
+
+private:
+    detail::searcher<GlobalState, State> s;
+};
+
+
+// Solves every initial state, sharding the queries across thread_count threads which each keep their
+// own a_star_session (and therefore their own heuristic cache, so no locking is needed).
+// global_state is shared between the threads, so the State member functions must not modify it.
+// The result at index i is the path for initial_states[i].
+template<typename GlobalState, SearchProblemState<GlobalState> State>
+std::vector<std::deque<State>> a_star_search_batch(const std::vector<State> &initial_states, GlobalState &global_state, 
+        std::size_t thread_count = std::thread::hardware_concurrency(), std::size_t heuristic_cache_size = 0) {
+    std::vector<std::deque<State>> paths(initial_states.size());
+    thread_count = std::clamp<std::size_t>(thread_count, 1, std::max<std::size_t>(initial_states.size(), 1));
+
+    std::atomic<std::size_t> next_query = 0;
+
+    run_workers(thread_count, [&](std::size_t, const std::atomic<bool> &failed) {
+        a_star_session<GlobalState, State> session(global_state, heuristic_cache_size);
+        for(std::size_t i = next_query++; i < initial_states.size() && !failed; i = next_query++)
+            paths[i] = session.search(initial_states[i]);
+    });
+    return paths;
 }
 
 
@@ -0,0 +1,148 @@
+#ifndef LIPH_BEAM_SEARCH_HPP
+#define LIPH_BEAM_SEARCH_HPP
+
+#include "a_star_search.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <utility>
+#include <vector>
+
+
+namespace detail {
+
+
+template<typename GlobalState, SearchProblemState<GlobalState> State>
+class beam_searcher : problem<GlobalState, State> {
+    using base = problem<GlobalState, State>;
+    using base::accrued_cost;
+    using base::estimated_remaining_cost;
+    using base::get_next_states;
+    using base::done;
+
+public:
+    using cost_type = typename base::cost_type;
+
+    struct link_type {
+        using state_type = State;
+        State state;
+        cost_type accrued_cost;
+        const link_type *prev;
+    };
+
+private:
+    struct candidate_type {
+        State state;
+        cost_type accrued_cost;
+        cost_type estimated_total_cost;
+        const link_type *prev;
+
+        // the candidates are kept in a max-heap, so the worst one is on top to be replaced
+        bool operator<(const candidate_type &other) const {
+            return estimated_total_cost < other.estimated_total_cost;
+        }
+    };
+
+public:
+    beam_searcher(GlobalState &global_state, std::size_t beam_width)
+        : base(global_state), width(std::max<std::size_t>(beam_width, 1)) {
+        beam.reserve(width);
+        candidates.reserve(width);
+    }
+
+    const link_type *run(const State &initial_state, std::size_t max_depth) {
+        links.push_back(link_type{initial_state, cost_type{}, nullptr});
+        if(done(initial_state))
+            return &links.back();
+
+        beam.push_back(&links.back());
+
+        for(std::size_t depth = 0; depth < max_depth && !beam.empty(); ++depth) {
+            for(const link_type *link : beam)
+                add_candidates(link);
+
+            beam.clear();
+            const link_type *best_done = nullptr;
+
+            for(candidate_type &candidate : candidates) {
+                links.push_back(link_type{std::move(candidate.state), candidate.accrued_cost, candidate.prev});
+                const link_type *link = &links.back();
+
+                if(!done(link->state))
+                    beam.push_back(link);
+                else if(!best_done || link->accrued_cost < best_done->accrued_cost)
+                    best_done = link;
+            }
+            candidates.clear();
+
+            if(best_done)
+                return best_done;
+        }
+
+        return nullptr;
+    }
+
+private:
+    void add_candidates(const link_type *prev_link) {
+        for(auto &next : get_next_states(prev_link->state)) {
+            cost_type accrued = accrued_cost(prev_link->accrued_cost, next);
+            cost_type estimated = accrued + estimated_remaining_cost(next);
+
+            // states reachable from several states in the beam would otherwise crowd it out
+            auto duplicate = std::find_if(candidates.begin(), candidates.end(), [&](const candidate_type &c) {
+                return same_state(c.state, next);
+            });
+
+            if(duplicate != candidates.end()) {
+                if(accrued < duplicate->accrued_cost) {
+                    *duplicate = candidate_type{std::move(next), accrued, estimated, prev_link};
+                    std::make_heap(candidates.begin(), candidates.end());
+                }
+            } else if(candidates.size() < width) {
+                candidates.push_back(candidate_type{std::move(next), accrued, estimated, prev_link});
+                std::push_heap(candidates.begin(), candidates.end());
+            } else if(estimated < candidates.front().estimated_total_cost) {
+                std::pop_heap(candidates.begin(), candidates.end());
+                candidates.back() = candidate_type{std::move(next), accrued, estimated, prev_link};
+                std::push_heap(candidates.begin(), candidates.end());
+            }
+        }
+    }
+
+    static bool same_state(const State &left, const State &right) {
+        if constexpr(UnorderedSetStorable<State>)
+            return left == right;
+        else if constexpr(LessThanComparable<State>)
+            return !(left < right) && !(right < left);
+        else
+            return false;
+    }
+
+    std::size_t width;
+    std::deque<link_type> links;
+    std::vector<const link_type*> beam;
+    std::vector<candidate_type> candidates;
+};
+
+
+} // namespace detail
+
+
+
+// Like a_star_search, but only the beam_width states with the lowest accrued + estimated_remaining_cost
+// survive each depth, so the path found is not necessarily the cheapest one (or found at all).
+// The frontier never holds more than beam_width states and there is no closed set, so memory use is
+// bounded by beam_width * depth regardless of how large the state space is. Duplicate states are only
+// detected within the same depth (if State has == or <), so max_depth should be given if the states can
+// form cycles.
+template<typename GlobalState, SearchProblemState<GlobalState> State>
+std::deque<State> beam_search(const State &initial_state, GlobalState &global_state, std::size_t beam_width,
+        std::size_t max_depth = std::numeric_limits<std::size_t>::max()) {
+    detail::beam_searcher<GlobalState, State> s(global_state, beam_width);
+    return detail::make_path(s.run(initial_state, max_depth));
+}
+
+
+#endif
@@ -0,0 +1,385 @@
+// build with optimizations, e.g.:  g++ -std=c++20 -fconcepts-ts -O2 -pthread benchmark.cpp
+#include "a_star_search.hpp"
+#include "fingerprint_search.hpp"
+#include "../alloc_counter/alloc_counter.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+
+// which container_type the searcher ends up using depends only upon which operators State defines
+enum class dedup { set, unordered_set, deque, fingerprint };
+
+const char *dedup_name(dedup d) {
+    switch(d) {
+    case dedup::set: return "set";
+    case dedup::unordered_set: return "unordered_set";
+    case dedup::deque: return "deque";
+    case dedup::fingerprint: return "fingerprint";
+    }
+    return "";
+}
+
+constexpr bool is_hashed(dedup d) { return d == dedup::unordered_set || d == dedup::fingerprint; }
+
+
+struct budget_exceeded {};
+
+struct search_stats {
+    std::size_t expanded = 0;
+    std::size_t generated = 0;
+    std::size_t budget = 0;
+
+    void expand(std::size_t next_count) {
+        if(++expanded > budget)
+            throw budget_exceeded();
+        generated += next_count;
+    }
+};
+
+
+
+struct grid_map {
+    std::uint32_t width;
+    std::uint32_t height;
+    std::vector<unsigned char> blocked;
+};
+
+struct grid_global {
+    const grid_map *map;
+    std::uint32_t dest;
+    search_stats stats;
+};
+
+template<dedup D>
+struct grid_state {
+    std::uint32_t cell;
+
+    std::size_t additional_cost() const { return 1; }
+
+    std::size_t estimated_remaining_cost(grid_global &g) const {
+        std::uint32_t x = cell % g.map->width, y = cell / g.map->width;
+        std::uint32_t dx = g.dest % g.map->width, dy = g.dest / g.map->width;
+        return (x < dx ? dx - x : x - dx) + (y < dy ? dy - y : y - dy);
+    }
+
+    bool done(grid_global &g) const { return cell == g.dest; }
+
+    std::vector<grid_state> next_states(grid_global &g) const {
+        const grid_map &map = *g.map;
+        std::uint32_t x = cell % map.width, y = cell / map.width;
+
+        std::vector<grid_state> states;
+        if(x > 0 && !map.blocked[cell - 1])                  states.push_back(grid_state{cell - 1});
+        if(x + 1 < map.width && !map.blocked[cell + 1])      states.push_back(grid_state{cell + 1});
+        if(y > 0 && !map.blocked[cell - map.width])          states.push_back(grid_state{cell - map.width});
+        if(y + 1 < map.height && !map.blocked[cell + map.width]) states.push_back(grid_state{cell + map.width});
+
+        g.stats.expand(states.size());
+        return states;
+    }
+
+    bool operator<(const grid_state &other) const requires (D == dedup::set) { return cell < other.cell; }
+    bool operator==(const grid_state &other) const requires (is_hashed(D)) { return cell == other.cell; }
+};
+
+template<dedup D>
+    requires (is_hashed(D))
+struct std::hash<grid_state<D>> {
+    std::size_t operator()(const grid_state<D> &s) const { return s.cell; }
+};
+
+
+
+struct puzzle_global {
+    search_stats stats;
+};
+
+template<dedup D>
+struct puzzle_state {
+    std::array<std::uint8_t, 16> tiles;   // tile 0 is the blank; solved when tiles[i] == i
+    std::uint8_t blank;
+
+    std::size_t additional_cost() const { return 1; }
+
+    std::size_t estimated_remaining_cost() const {
+        std::size_t distance = 0;
+        for(int i = 0; i < 16; ++i)
+            if(tiles[i])
+                distance += std::abs(i % 4 - tiles[i] % 4) + std::abs(i / 4 - tiles[i] / 4);
+        return distance;
+    }
+
+    bool done() const { return estimated_remaining_cost() == 0; }
+
+    std::vector<puzzle_state> next_states(puzzle_global &g) const {
+        std::vector<puzzle_state> states;
+        for(int move : {-4, 4, -1, 1}) {
+            if(auto next = slide(move))
+                states.push_back(*next);
+        }
+
+        g.stats.expand(states.size());
+        return states;
+    }
+
+    std::optional<puzzle_state> slide(int move) const {
+        int to = blank + move;
+        if(to < 0 || to >= 16 || (std::abs(move) == 1 && to / 4 != blank / 4))
+            return std::nullopt;
+
+        puzzle_state next = *this;
+        std::swap(next.tiles[blank], next.tiles[to]);
+        next.blank = static_cast<std::uint8_t>(to);
+        return next;
+    }
+
+    bool operator<(const puzzle_state &other) const requires (D == dedup::set) { return tiles < other.tiles; }
+    bool operator==(const puzzle_state &other) const requires (is_hashed(D)) { return tiles == other.tiles; }
+};
+
+template<dedup D>
+    requires (is_hashed(D))
+struct std::hash<puzzle_state<D>> {
+    std::size_t operator()(const puzzle_state<D> &s) const {
+        std::uint64_t packed = 0;
+        for(std::uint8_t tile : s.tiles)
+            packed = (packed << 4) | tile;
+        return packed;
+    }
+};
+
+
+
+struct road_network {
+    std::vector<std::pair<double, double>> positions;
+    std::vector<std::vector<std::pair<std::uint32_t, double>>> roads;
+};
+
+struct road_global {
+    const road_network *network;
+    std::uint32_t dest;
+    search_stats stats;
+};
+
+template<dedup D>
+struct road_state {
+    std::uint32_t node;
+    double cost;
+
+    double additional_cost() const { return cost; }
+
+    double estimated_remaining_cost(road_global &g) const {
+        auto [x, y] = g.network->positions[node];
+        auto [dx, dy] = g.network->positions[g.dest];
+        return std::hypot(dx - x, dy - y);
+    }
+
+    bool done(road_global &g) const { return node == g.dest; }
+
+    std::vector<road_state> next_states(road_global &g) const {
+        std::vector<road_state> states;
+        for(auto [to, road_cost] : g.network->roads[node])
+            states.push_back(road_state{to, road_cost});
+
+        g.stats.expand(states.size());
+        return states;
+    }
+
+    bool operator<(const road_state &other) const requires (D == dedup::set) { return node < other.node; }
+    bool operator==(const road_state &other) const requires (is_hashed(D)) { return node == other.node; }
+};
+
+template<dedup D>
+    requires (is_hashed(D))
+struct std::hash<road_state<D>> {
+    std::size_t operator()(const road_state<D> &s) const { return s.node; }
+};
+
+
+
+grid_map make_grid_map(std::uint32_t width, std::uint32_t height, double obstacle_ratio, std::mt19937 &rng) {
+    std::bernoulli_distribution obstacle(obstacle_ratio);
+    grid_map map{width, height, std::vector<unsigned char>(width * height)};
+    for(auto &cell : map.blocked)
+        cell = obstacle(rng);
+    return map;
+}
+
+
+// scrambling by random moves from the solved state keeps every instance solvable
+std::array<std::uint8_t, 16> make_puzzle(int moves, std::mt19937 &rng) {
+    puzzle_state<dedup::deque> puzzle{{}, 0};
+    for(int i = 0; i < 16; ++i)
+        puzzle.tiles[i] = static_cast<std::uint8_t>(i);
+
+    std::uniform_int_distribution<int> direction(0, 3);
+    int last_move = 0;
+    while(moves > 0) {
+        int move = std::array<int, 4>{-4, 4, -1, 1}[direction(rng)];
+        auto next = puzzle.slide(move);
+        if(!next || move == -last_move)
+            continue;
+
+        puzzle = *next;
+        last_move = move;
+        --moves;
+    }
+    return puzzle.tiles;
+}
+
+
+// a jittered grid of intersections, each joined to its neighbours (and sometimes diagonally)
+// by roads which are never shorter than the straight line distance
+road_network make_road_network(std::uint32_t side, std::mt19937 &rng) {
+    std::uniform_real_distribution<double> jitter(-0.3, 0.3);
+    std::uniform_real_distribution<double> detour(1.0, 1.5);
+    std::bernoulli_distribution diagonal(0.3);
+
+    road_network network;
+    for(std::uint32_t y = 0; y < side; ++y)
+        for(std::uint32_t x = 0; x < side; ++x)
+            network.positions.emplace_back(x + jitter(rng), y + jitter(rng));
+    network.roads.resize(side * side);
+
+    auto connect = [&](std::uint32_t from, std::uint32_t to) {
+        auto [x1, y1] = network.positions[from];
+        auto [x2, y2] = network.positions[to];
+        double cost = std::hypot(x2 - x1, y2 - y1) * detour(rng);
+        network.roads[from].emplace_back(to, cost);
+        network.roads[to].emplace_back(from, cost);
+    };
+
+    for(std::uint32_t y = 0; y < side; ++y) {
+        for(std::uint32_t x = 0; x < side; ++x) {
+            std::uint32_t node = y * side + x;
+            if(x + 1 < side)
+                connect(node, node + 1);
+            if(y + 1 < side)
+                connect(node, node + side);
+            if(x + 1 < side && y + 1 < side && diagonal(rng))
+                connect(node, node + side + 1);
+        }
+    }
+    return network;
+}
+
+
+
+template<dedup D, typename State, typename GlobalState>
+std::deque<State> run_search(const State &initial_state, GlobalState &global_state) {
+    if constexpr(D == dedup::fingerprint)
+        return a_star_search(initial_state, global_state, fingerprint_dedup);
+    else
+        return a_star_search(initial_state, global_state);
+}
+
+
+// Query(i) returns the initial state and global state for the i'th query
+template<dedup D, typename Query>
+void benchmark(const char *workload, std::size_t queries, std::size_t budget, Query query) {
+    using clock = std::chrono::steady_clock;
+
+    std::size_t expanded = 0, generated = 0, solved = 0, abandoned = 0, bytes = 0;
+    double total_seconds = 0, worst_seconds = 0;
+
+    for(std::size_t i = 0; i < queries; ++i) {
+        auto [initial_state, global_state] = query(i);
+        global_state.stats.budget = budget;
+
+        std::size_t base_bytes = alloc_counter::live_bytes;
+        alloc_counter::peak_bytes = alloc_counter::live_bytes;
+        auto start = clock::now();
+
+        try {
+            solved += !run_search<D>(initial_state, global_state).empty();
+        } catch(budget_exceeded &) {
+            ++abandoned;
+        }
+
+        double seconds = std::chrono::duration<double>(clock::now() - start).count();
+        total_seconds += seconds;
+        worst_seconds = std::max(worst_seconds, seconds);
+        expanded += global_state.stats.expanded;
+        generated += global_state.stats.generated;
+        bytes += alloc_counter::peak_bytes - base_bytes;
+    }
+
+    std::cout << std::left << std::setw(10) << workload << std::setw(15) << dedup_name(D) << std::right << std::fixed
+              << std::setw(8) << solved << '/' << std::left << std::setw(6) << queries << std::right
+              << std::setw(10) << abandoned
+              << std::setw(14) << std::setprecision(0) << expanded / std::max(total_seconds, 1e-9)
+              << std::setw(12) << std::setprecision(1) << double(bytes) / std::max<std::size_t>(generated, 1)
+              << std::setw(14) << std::setprecision(1) << total_seconds / queries * 1e6
+              << std::setw(14) << std::setprecision(1) << worst_seconds * 1e6 << '\n';
+}
+
+
+template<dedup D>
+void benchmark_all(const grid_map &grid, const std::vector<std::pair<std::uint32_t, std::uint32_t>> &grid_queries,
+                   const std::vector<std::array<std::uint8_t, 16>> &puzzles,
+                   const road_network &roads, const std::vector<std::pair<std::uint32_t, std::uint32_t>> &road_queries) {
+    // without duplicate detection the searches blow up exponentially, so give up on them early
+    std::size_t budget = D == dedup::deque ? 200000 : 5000000;
+
+    benchmark<D>("grid", grid_queries.size(), budget, [&](std::size_t i) {
+        return std::pair(grid_state<D>{grid_queries[i].first}, grid_global{&grid, grid_queries[i].second, {}});
+    });
+
+    benchmark<D>("15-puzzle", puzzles.size(), budget, [&](std::size_t i) {
+        auto blank = std::find(puzzles[i].begin(), puzzles[i].end(), 0) - puzzles[i].begin();
+        return std::pair(puzzle_state<D>{puzzles[i], static_cast<std::uint8_t>(blank)}, puzzle_global{});
+    });
+
+    benchmark<D>("road", road_queries.size(), budget, [&](std::size_t i) {
+        return std::pair(road_state<D>{road_queries[i].first, 0}, road_global{&roads, road_queries[i].second, {}});
+    });
+}
+
+
+int main() {
+    std::mt19937 rng(12345);
+
+    grid_map grid = make_grid_map(256, 256, 0.25, rng);
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> grid_queries;
+    std::uniform_int_distribution<std::uint32_t> grid_cell(0, grid.width * grid.height - 1);
+    while(grid_queries.size() < 100) {
+        std::uint32_t from = grid_cell(rng), to = grid_cell(rng);
+        if(from != to && !grid.blocked[from] && !grid.blocked[to])
+            grid_queries.emplace_back(from, to);
+    }
+
+    std::vector<std::array<std::uint8_t, 16>> puzzles;
+    while(puzzles.size() < 20)
+        puzzles.push_back(make_puzzle(36, rng));
+
+    road_network roads = make_road_network(150, rng);
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> road_queries;
+    std::uniform_int_distribution<std::uint32_t> road_node(0, roads.positions.size() - 1);
+    while(road_queries.size() < 100) {
+        std::uint32_t from = road_node(rng), to = road_node(rng);
+        if(from != to)
+            road_queries.emplace_back(from, to);
+    }
+
+    std::cout << std::left << std::setw(10) << "workload" << std::setw(15) << "container" << std::right
+              << std::setw(15) << "solved" << std::setw(10) << "abandoned"
+              << std::setw(14) << "expanded/s" << std::setw(12) << "bytes/state"
+              << std::setw(14) << "mean us" << std::setw(14) << "worst us" << '\n';
+
+    benchmark_all<dedup::set>(grid, grid_queries, puzzles, roads, road_queries);
+    benchmark_all<dedup::unordered_set>(grid, grid_queries, puzzles, roads, road_queries);
+    benchmark_all<dedup::deque>(grid, grid_queries, puzzles, roads, road_queries);
+    benchmark_all<dedup::fingerprint>(grid, grid_queries, puzzles, roads, road_queries);
+}
@@ -0,0 +1,244 @@
+#ifndef LIPH_FINGERPRINT_SEARCH_HPP
+#define LIPH_FINGERPRINT_SEARCH_HPP
+
+#include "a_star_search.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+struct fingerprint_dedup_t {};
+inline constexpr fingerprint_dedup_t fingerprint_dedup;
+
+
+namespace detail {
+
+
+template<typename T>
+concept HasFingerprint = requires(const T &x) {
+    { x.fingerprint() } -> ConvertibleTo<std::uint64_t>;
+};
+
+
+// fingerprints (and std::hash) are often the identity for integers, so mix the bits before
+// using them to pick a slot
+inline std::uint64_t mix_fingerprint(std::uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+template<typename State>
+std::uint64_t fingerprint(const State &state) {
+    if constexpr(HasFingerprint<State>) {
+        return state.fingerprint();
+    } else {
+        static_assert(UnorderedSetStorable<State>,
+                "fingerprint_dedup requires State to implement fingerprint() or to specialize std::hash");
+        return std::hash<State>{}(state);
+    }
+}
+
+
+// open addressing with linear probing, up to 3/4 full. only the fingerprint and the cheapest accrued
+// cost seen for it are stored; a fingerprint of 0 marks an empty slot.
+template<typename Cost>
+class fingerprint_table {
+    struct entry {
+        std::uint64_t fingerprint;
+        Cost accrued_cost;
+    };
+
+public:
+    fingerprint_table() : entries(16), count(0) {}
+
+    // returns false if the state was already reached with an accrued cost no greater than accrued_cost
+    bool improve(std::uint64_t fingerprint, const Cost &accrued_cost) {
+        if((count + 1) * 4 > entries.size() * 3)
+            grow();
+
+        entry &e = entries[find(fingerprint)];
+        if(e.fingerprint) {
+            if(!(accrued_cost < e.accrued_cost))
+                return false;
+            e.accrued_cost = accrued_cost;
+            return true;
+        }
+
+        e = entry{nonzero(fingerprint), accrued_cost};
+        ++count;
+        return true;
+    }
+
+    // true if a cheaper path to the state has been found since it was reached with accrued_cost
+    bool superseded(std::uint64_t fingerprint, const Cost &accrued_cost) const {
+        const entry &e = entries[find(fingerprint)];
+        return e.fingerprint && e.accrued_cost < accrued_cost;
+    }
+
+    std::size_t size() const { return count; }
+
+private:
+    static std::uint64_t nonzero(std::uint64_t fingerprint) { return fingerprint ? fingerprint : 1; }
+
+    std::size_t find(std::uint64_t fingerprint) const {
+        fingerprint = nonzero(fingerprint);
+        std::size_t mask = entries.size() - 1;
+        std::size_t i = mix_fingerprint(fingerprint) & mask;
+
+        while(entries[i].fingerprint && entries[i].fingerprint != fingerprint)
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    void grow() {
+        std::vector<entry> old(entries.size() * 2);
+        std::swap(old, entries);
+
+        for(entry &e : old)
+            if(e.fingerprint)
+                entries[find(e.fingerprint)] = std::move(e);
+    }
+
+    std::vector<entry> entries;
+    std::size_t count;
+};
+
+
+
+template<typename GlobalState, SearchProblemState<GlobalState> State>
+class fingerprint_searcher : problem<GlobalState, State> {
+    using base = problem<GlobalState, State>;
+    using base::accrued_cost;
+    using base::estimated_remaining_cost;
+    using base::get_next_states;
+    using base::done;
+
+public:
+    using cost_type = typename base::cost_type;
+
+    // a link is referenced by the open list and by each of its children, and is released
+    // once nothing references it, so only the states along live parent chains are kept
+    struct link_type {
+        using state_type = State;
+        State state;
+        cost_type accrued_cost;
+        link_type *prev;
+        std::uint32_t refs;
+    };
+
+private:
+    // the fingerprint isn't kept here, since it's cheaper to compute it again when the link is popped
+    // than to store it for every open state
+    struct next_link_type {
+        link_type *link;
+        cost_type estimated_total_cost;
+
+        bool operator>(const next_link_type &other) const {
+            return other.estimated_total_cost < estimated_total_cost;
+        }
+    };
+
+public:
+    fingerprint_searcher(GlobalState &global_state) : base(global_state) {}
+
+    const link_type *run(const State &initial_state) {
+        std::uint64_t initial_fingerprint = fingerprint(initial_state);
+        visited.improve(initial_fingerprint, cost_type{});
+        link_type *initial_link = add_link(initial_state, cost_type{}, nullptr);
+        next_states.push(next_link_type{initial_link, estimated_remaining_cost(initial_state)});
+
+        while(!next_states.empty()) {
+            next_link_type next = next_states.top();
+            if(done(next.link->state))
+                return next.link;
+
+            next_states.pop();
+            if(!visited.superseded(fingerprint(next.link->state), next.link->accrued_cost))
+                add_next_states(next.link);
+            release(next.link);
+        }
+
+        return nullptr;
+    }
+
+    std::size_t visited_count() const { return visited.size(); }
+
+private:
+    void add_next_states(link_type *prev_link) {
+        for(auto &next : get_next_states(prev_link->state)) {
+            cost_type accrued = accrued_cost(prev_link->accrued_cost, next);
+
+            std::uint64_t next_fingerprint = fingerprint(next);
+            if(!visited.improve(next_fingerprint, accrued))
+                continue;
+
+            cost_type estimated = accrued + estimated_remaining_cost(next);
+
+            if(estimated < accrued)
+                throw std::logic_error("estimated_remaining_cost cannot be negative");
+            if(!(accrued < estimated) && !done(next))
+                throw std::logic_error("estimated_remaining_cost cannot be zero unless the done state is reached");
+
+            link_type *link = add_link(std::move(next), accrued, prev_link);
+            next_states.push(next_link_type{link, estimated});
+        }
+    }
+
+    // released links are reused rather than destroyed, so the std::deque never has holes to track
+    link_type *add_link(State state, cost_type accrued, link_type *prev) {
+        if(prev)
+            ++prev->refs;
+
+        if(free_links.empty())
+            return &links.emplace_back(link_type{std::move(state), std::move(accrued), prev, 1});
+
+        link_type *link = free_links.back();
+        free_links.pop_back();
+        *link = link_type{std::move(state), std::move(accrued), prev, 1};
+        return link;
+    }
+
+    void release(link_type *link) {
+        while(link && --link->refs == 0) {
+            free_links.push_back(link);
+            link = link->prev;
+        }
+    }
+
+    fingerprint_table<cost_type> visited;
+    std::deque<link_type> links;
+    std::vector<link_type*> free_links;
+    std::priority_queue<next_link_type, std::vector<next_link_type>, std::greater<next_link_type>> next_states;
+};
+
+
+} // namespace detail
+
+
+
+// Same as a_star_search, but visited states are remembered only by a 64-bit fingerprint (from
+// State::fingerprint() if it exists, otherwise from std::hash<State>) instead of by storing the whole
+// State, and states no longer on the path to any state in the open list are freed. If two distinct
+// states ever share a fingerprint, the second one will be wrongly treated as already visited.
+//
+// This is usually faster than a_star_search, but it only uses less memory when State is large and many
+// expanded states turn out to be dead ends: every state on a live path still needs a link, and the
+// fingerprint table is kept on top of that. For small states, like those in benchmark.cpp, it uses more.
+template<typename GlobalState, SearchProblemState<GlobalState> State>
+std::deque<State> a_star_search(const State &initial_state, GlobalState &global_state, fingerprint_dedup_t) {
+    detail::fingerprint_searcher<GlobalState, State> s(global_state);
+    return detail::make_path(s.run(initial_state));
+}
+
+
+#endif
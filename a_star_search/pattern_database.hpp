@@ -0,0 +1,257 @@
+#ifndef LIPH_PATTERN_DATABASE_HPP
+#define LIPH_PATTERN_DATABASE_HPP
+
+#include "../precompute/precompute.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/* A pattern database maps each state of a smaller, abstract version of the search problem to the exact
+ * cost of reaching an abstract goal from it. Abstract states are identified by an index in [0, size),
+ * and the distances are found by searching backwards from the goals, so looking one up with the index
+ * of the abstraction of a State gives an admissible estimated_remaining_cost for it.
+ *
+ * predecessors(index) must return a container of the abstract states from which index can be reached:
+ * either plain indexes (every move costs 1, and a breadth-first search is used) or
+ * std::pair<std::size_t, Distance> of index and cost (and Dijkstra's algorithm is used).
+ *
+ * Example usage, with State::estimated_remaining_cost returning global_state.pdb(abstract_index(*this)):
+
+pattern_database<std::uint8_t> pdb(9 * 8 * 7 * 6, goal_indexes, [](std::size_t index) {
+    std::vector<std::size_t> prev;
+    ...
+    return prev;
+});
+pdb.save("fringe.pdb");
+...
+pattern_database<std::uint8_t> loaded = pattern_database<std::uint8_t>::load("fringe.pdb");  // mmap'd
+
+*/
+
+
+namespace detail {
+
+
+template<typename T, typename = void>
+constexpr bool is_weighted_predecessor = false;
+
+template<typename T>
+constexpr bool is_weighted_predecessor<T, std::void_t<decltype(std::declval<T>().second)>> = true;
+
+
+struct pattern_database_header {
+    char magic[8];
+    std::uint32_t distance_size;
+    std::uint32_t reserved;
+    std::uint64_t size;
+};
+
+inline constexpr char pattern_database_magic[8] = {'L', 'I', 'P', 'H', 'P', 'D', 'B', '1'};
+
+
+} // namespace detail
+
+
+
+template<typename Distance = std::uint8_t>
+class pattern_database {
+    static_assert(std::is_unsigned_v<Distance>, "pattern_database distances must be an unsigned integer type");
+
+public:
+    // the distance of abstract states from which no goal can be reached
+    static constexpr Distance unreachable = std::numeric_limits<Distance>::max();
+
+    template<typename Goals, typename Predecessors>
+    pattern_database(std::size_t size, const Goals &goals, Predecessors predecessors) {
+        auto table = std::make_shared<std::vector<Distance>>(size, unreachable);
+        build(*table, goals, predecessors);
+        distances = table->data();
+        count = size;
+        storage = std::move(table);
+    }
+
+    Distance operator()(std::size_t index) const { return distances[index]; }
+
+    std::size_t size() const { return count; }
+
+    // returns a callable which looks up the distance of a State, given a function from State to index
+    template<typename Abstraction>
+    auto heuristic(Abstraction abstraction) const {
+        return [db = *this, abstraction = std::move(abstraction)](const auto &state) { return db(abstraction(state)); };
+    }
+
+    void save(const std::string &path) const {
+        detail::pattern_database_header header{{}, sizeof(Distance), 0, count};
+        std::memcpy(header.magic, detail::pattern_database_magic, sizeof header.magic);
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof header);
+        out.write(reinterpret_cast<const char*>(distances), count * sizeof(Distance));
+        if(!out)
+            throw std::runtime_error("unable to write pattern database " + path);
+    }
+
+    // the file is memory-mapped rather than read, so only the pages which are looked up get loaded
+    static pattern_database load(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            throw std::runtime_error("unable to open pattern database " + path);
+
+        struct stat st;
+        void *mapped = MAP_FAILED;
+        if(::fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(detail::pattern_database_header))
+            mapped = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if(mapped == MAP_FAILED)
+            throw std::runtime_error("unable to map pattern database " + path);
+
+        std::size_t length = st.st_size;
+        std::shared_ptr<const void> mapping(mapped, [length](const void *p) { ::munmap(const_cast<void*>(p), length); });
+
+        detail::pattern_database_header header;
+        std::memcpy(&header, mapped, sizeof header);
+        if(std::memcmp(header.magic, detail::pattern_database_magic, sizeof header.magic) != 0
+                || header.distance_size != sizeof(Distance)
+                || header.size != (length - sizeof header) / sizeof(Distance))
+            throw std::runtime_error("invalid pattern database " + path);
+
+        // heuristic lookups jump all over the table
+        ::madvise(mapped, length, MADV_RANDOM);
+        return pattern_database(std::move(mapping),
+                reinterpret_cast<const Distance*>(static_cast<const char*>(mapped) + sizeof header), header.size);
+    }
+
+private:
+    pattern_database(std::shared_ptr<const void> storage, const Distance *distances, std::size_t count)
+        : storage(std::move(storage)), distances(distances), count(count) {}
+
+    template<typename Goals, typename Predecessors>
+    static void build(std::vector<Distance> &table, const Goals &goals, Predecessors &predecessors) {
+        using predecessor_t = std::decay_t<decltype(*std::begin(predecessors(std::size_t())))>;
+
+        if constexpr(detail::is_weighted_predecessor<predecessor_t>) {
+            using entry = std::pair<Distance, std::size_t>;
+            std::priority_queue<entry, std::vector<entry>, std::greater<entry>> queue;
+            for(std::size_t goal : goals) {
+                table.at(goal) = 0;
+                queue.emplace(0, goal);
+            }
+
+            while(!queue.empty()) {
+                auto [distance, index] = queue.top();
+                queue.pop();
+                if(table[index] < distance)
+                    continue;
+
+                for(auto &&[prev, cost] : predecessors(index)) {
+                    Distance prev_distance = add(distance, cost);
+                    if(prev_distance < table.at(prev)) {
+                        table[prev] = prev_distance;
+                        queue.emplace(prev_distance, prev);
+                    }
+                }
+            }
+        } else {
+            std::deque<std::size_t> queue;
+            for(std::size_t goal : goals) {
+                table.at(goal) = 0;
+                queue.push_back(goal);
+            }
+
+            while(!queue.empty()) {
+                std::size_t index = queue.front();
+                queue.pop_front();
+
+                for(std::size_t prev : predecessors(index)) {
+                    if(table.at(prev) == unreachable) {
+                        table[prev] = add(table[index], 1);
+                        queue.push_back(prev);
+                    }
+                }
+            }
+        }
+    }
+
+    // cost is checked in its own type, so that a cost too big for Distance isn't silently truncated
+    template<typename Cost>
+    static Distance add(Distance distance, Cost cost) {
+        static_assert(std::is_integral_v<Cost>, "pattern_database move costs must be integers");
+        if(std::cmp_less(cost, 0))
+            throw std::invalid_argument("pattern_database move costs cannot be negative");
+        if(std::cmp_greater_equal(cost, unreachable - distance))
+            throw std::overflow_error("pattern_database distance does not fit in the Distance type");
+        return static_cast<Distance>(distance + cost);
+    }
+
+    std::shared_ptr<const void> storage;
+    const Distance *distances;
+    std::size_t count;
+};
+
+
+
+// For abstract spaces small enough to be searched at compile time. Only unit cost moves are supported.
+template<std::size_t Size, typename Distance = std::uint8_t, typename Goals, typename Predecessors>
+constexpr std::array<Distance, Size> build_pattern_table(const Goals &goals, Predecessors predecessors) {
+    constexpr Distance unreachable = std::numeric_limits<Distance>::max();
+
+    std::array<Distance, Size> table{};
+    std::array<std::size_t, Size> queue{};
+    std::size_t head = 0, tail = 0;
+
+    for(Distance &distance : table)
+        distance = unreachable;
+
+    for(std::size_t goal : goals) {
+        if(table[goal] != 0) {
+            table[goal] = 0;
+            queue[tail++] = goal;
+        }
+    }
+
+    // a throw stops compilation when the table is built in a constant expression
+    while(head != tail) {
+        std::size_t index = queue[head++];
+        for(std::size_t prev : predecessors(index)) {
+            if(table[prev] == unreachable) {
+                if(table[index] + 1 >= unreachable)
+                    throw std::overflow_error("pattern_database distance does not fit in the Distance type");
+                table[prev] = static_cast<Distance>(table[index] + 1);
+                queue[tail++] = prev;
+            }
+        }
+    }
+
+    return table;
+}
+
+
+template<std::size_t Size, typename Distance = std::uint8_t, typename Goals, typename Predecessors>
+constexpr precompute<Distance, Size> make_precomputed_pattern_database(const Goals &goals, Predecessors predecessors) {
+    std::array<Distance, Size> table = build_pattern_table<Size, Distance>(goals, predecessors);
+    return precompute<Distance, Size>([table](std::size_t index) { return table[index]; });
+}
+
+
+#endif
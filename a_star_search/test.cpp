@@ -1,8 +1,14 @@
 #include "a_star_search.hpp"
+#include "beam_search.hpp"
+#include "fingerprint_search.hpp"
+#include "pattern_database.hpp"
 
 #include <iostream>
 #include <cstddef>
+#include <cstdint>
 #include <deque>
+#include <functional>
+#include <stdexcept>
 #include <tuple>
 #include <vector>
 
@@ -42,6 +48,7 @@ namespace detail {
 struct grid_state {
     const matrix<cell_type> *grid;
     point dest;
+    mutable std::size_t expanded = 0;
 };
 
 
@@ -62,6 +69,7 @@ public:
     };
 
     std::vector<shortest_path_state> next_states(const grid_state &global_state) const {
+        ++global_state.expanded;
         std::vector<shortest_path_state> states;
         add_next_state(global_state, states, -1,  0);
         add_next_state(global_state, states,  1,  0);
@@ -72,6 +80,9 @@ public:
 
     point current() const { return cur; }
 
+    // only used by a_star_search(..., fingerprint_dedup)
+    std::uint64_t fingerprint() const { return (std::uint64_t(cur.x) << 32) | cur.y; }
+
     // define < so that states are checked to see if they are already visited
     // (states will be stored in a std::set)
     bool operator<(const shortest_path_state &other) const {
@@ -102,6 +113,36 @@ private:
 };
 
 
+// the same moves, but estimated_remaining_cost is looked up in a pattern database
+struct pdb_global_state {
+    grid_state grid;
+    std::function<std::uint8_t(point)> remaining;
+};
+
+class pdb_path_state {
+public:
+    pdb_path_state(point current) : pos(current) {}
+
+    bool done(const pdb_global_state &global_state) const { return pos.done(global_state.grid); }
+
+    std::size_t additional_cost() const { return 1; }
+
+    std::size_t estimated_remaining_cost(const pdb_global_state &global_state) const { return global_state.remaining(pos.current()); }
+
+    std::vector<pdb_path_state> next_states(const pdb_global_state &global_state) const {
+        std::vector<pdb_path_state> states;
+        for(auto &next : pos.next_states(global_state.grid))
+            states.push_back(pdb_path_state{next.current()});
+        return states;
+    }
+
+    bool operator<(const pdb_path_state &other) const { return pos < other.pos; }
+
+private:
+    shortest_path_state pos;
+};
+
+
 } // namespace detail
 
 /* // see above comment about ==
@@ -157,4 +198,68 @@ int main() {
     std::cout << path.size() << '\n';
     for(point p : path)
         std::cout << p.x << ", " << p.y << '\n';
+
+    // many queries against the same grid and destination
+    detail::grid_state global_state = {&grid, point{6, 5}};
+    a_star_session<detail::grid_state, detail::shortest_path_state> session(global_state);
+    std::cout << session.search(point{0, 0}).size() << ' ' << session.search(point{7, 0}).size() << '\n';
+
+    std::vector<detail::shortest_path_state> starts = {point{0, 0}, point{7, 0}, point{0, 6}, point{3, 4}};
+    for(auto &batch_path : a_star_search_batch(starts, global_state, 2))
+        std::cout << batch_path.size() << ' ';
+    std::cout << '\n';
+
+    // not guaranteed to be the shortest path, but only keeps the 4 most promising states per step
+    std::cout << beam_search(detail::shortest_path_state{point{0, 0}}, global_state, 4, 64).size() << '\n';
+
+    // visited states are only remembered by their fingerprint()
+    std::cout << a_star_search(detail::shortest_path_state{point{0, 0}}, global_state, fingerprint_dedup).size() << '\n';
+
+    // exact distances to (6, 5) for every cell, found by searching backwards from it
+    pattern_database<std::uint8_t> distances(grid.width() * grid.height(), std::vector<std::size_t>{5 * grid.width() + 6},
+        [&](std::size_t index) {
+            std::vector<std::size_t> prev;
+            for(auto &next : detail::shortest_path_state{point{index % grid.width(), index / grid.width()}}.next_states(global_state))
+                prev.push_back(next.current().y * grid.width() + next.current().x);
+            return prev;
+        });
+    auto exact_remaining_cost = distances.heuristic([&](point p) { return p.y * grid.width() + p.x; });
+    std::cout << int(exact_remaining_cost(point{0, 0})) << '\n';
+
+    // with an exact heuristic, only the states along a shortest path are expanded
+    detail::pdb_global_state pdb_state = {{&grid, point{6, 5}}, exact_remaining_cost};
+    std::cout << a_star_search(detail::pdb_path_state{point{0, 0}}, pdb_state).size() << ' ' << pdb_state.grid.expanded << '\n';
+
+    // distances up to 254 fit in std::uint8_t (255 is unreachable), but a chain of 300 states doesn't
+    auto chain = [](std::size_t length) {
+        return pattern_database<std::uint8_t>(length, std::vector<std::size_t>{0}, [length](std::size_t index) {
+            return std::vector<std::size_t>{index + 1 < length ? index + 1 : index};
+        });
+    };
+    std::cout << int(chain(255)(254)) << '\n';
+    try {
+        chain(300);
+    } catch(const std::overflow_error &) {
+        std::cout << "overflow\n";
+    }
+
+    // costs are range-checked rather than truncated to std::uint8_t
+    try {
+        pattern_database<std::uint8_t> weighted(2, std::vector<std::size_t>{0}, [](std::size_t index) {
+            return std::vector<std::pair<std::size_t, int>>{{1 - index, 256}};
+        });
+    } catch(const std::overflow_error &) {
+        std::cout << "overflow\n";
+    }
+
+    // abstracting away everything but the column gives a database small enough to build at compile time
+    constexpr auto column_distances = make_precomputed_pattern_database<8>(std::array<std::size_t, 1>{6}, [](std::size_t column) {
+        return std::array<std::size_t, 2>{column == 0 ? 1 : column - 1, column == 7 ? 6 : column + 1};
+    });
+    static_assert(column_distances(0) == 6 && column_distances(7) == 1);
+
+    // an open grid has many paths of the same cost to each cell, and each cell should still only be expanded once
+    matrix<cell_type> open_grid(12, 12);
+    detail::grid_state open_state = {&open_grid, point{11, 11}};
+    std::cout << a_star_search(detail::shortest_path_state{point{0, 0}}, open_state).size() << ' ' << open_state.expanded << '\n';
 }
@@ -0,0 +1,72 @@
+#ifndef LIPH_ALLOC_COUNTER_HPP
+#define LIPH_ALLOC_COUNTER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+
+/* Replaces the global operator new and operator delete with ones which keep count of what's allocated,
+ * so that a benchmark can report how much memory the code it measures allocates:
+ *
+ *     std::size_t before = alloc_counter::count;
+ *     run();
+ *     std::cout << alloc_counter::count - before << " allocations\n";
+ *
+ * Since this defines those operators, it must be included by only one source file of a program. The
+ * counters aren't atomic, so are only accurate while one thread at a time is allocating.
+ */
+
+namespace alloc_counter {
+
+
+inline std::size_t count = 0;        // allocations made so far
+inline std::size_t total_bytes = 0;  // bytes allocated so far
+inline std::size_t live_bytes = 0;   // bytes allocated which haven't been freed yet
+inline std::size_t peak_bytes = 0;   // the most live_bytes has been (reset it to live_bytes to start again)
+
+
+namespace detail {
+
+
+// each allocation starts with its size, padded so that the memory after it is still suitably aligned
+constexpr std::size_t header_size = alignof(std::max_align_t);
+
+// kept out of line so the compiler doesn't see free() called on memory from operator new
+[[gnu::noinline]] inline void *counted_malloc(std::size_t size) {
+    char *p = static_cast<char*>(std::malloc(size + header_size));
+    if(!p)
+        throw std::bad_alloc();
+
+    *reinterpret_cast<std::size_t*>(p) = size;
+    ++count;
+    total_bytes += size;
+    live_bytes += size;
+    peak_bytes = std::max(peak_bytes, live_bytes);
+    return p + header_size;
+}
+
+[[gnu::noinline]] inline void counted_free(void *ptr) {
+    if(!ptr)
+        return;
+
+    char *p = static_cast<char*>(ptr) - header_size;
+    live_bytes -= *reinterpret_cast<std::size_t*>(p);
+    std::free(p);
+}
+
+
+} // namespace detail
+
+} // namespace alloc_counter
+
+
+void *operator new(std::size_t size) { return alloc_counter::detail::counted_malloc(size); }
+
+void operator delete(void *ptr) noexcept { alloc_counter::detail::counted_free(ptr); }
+
+void operator delete(void *ptr, std::size_t) noexcept { alloc_counter::detail::counted_free(ptr); }
+
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef LIPH_CACHED_FUNCTION_BATCH_HPP
+#define LIPH_CACHED_FUNCTION_BATCH_HPP
+
+#include "cache_table.hpp"
+#include "../parallel_for/parallel_for.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+// passed to get_many to compute the misses on this many threads (f must be safe to call from several at once)
+struct fan_out {
+    std::size_t threads;
+};
+
+
+namespace detail {
+
+
+// what get_many returns for each key: references are returned as std::reference_wrappers
+template<typename CallState>
+using many_value_t = std::conditional_t<std::is_reference_v<typename CallState::return_t>,
+    std::reference_wrapper<std::remove_reference_t<typename CallState::return_t>>, typename CallState::return_t>;
+
+
+// one of f's parameters, made from the stored one: a const T & parameter is given the stored parameter itself,
+// and any other a copy of it, which f may move from (e.g. a T && parameter is given an rvalue)
+template<typename Param, typename Stored>
+decltype(auto) pass_param(const Stored &stored) {
+    if constexpr(std::is_lvalue_reference_v<Param>)
+        return stored;
+    else
+        return Stored(stored);
+}
+
+template<typename CallState, typename F, std::size_t... I>
+CallState compute_call(F &f, typename CallState::stored_params_t &&params, std::index_sequence<I...>) {
+    using params_t = typename CallState::params_t;
+    // the parameters are only moved into the call_state once f has returned
+    return CallState(f(pass_param<std::tuple_element_t<I, params_t>>(std::get<I>(params))...), std::get<I>(std::move(params))...);
+}
+
+// calls f with params, and returns the call_state of the call, which keeps params. see pass_param for how
+// f is given them.
+template<typename CallState, typename F>
+CallState compute_call(F &f, typename CallState::stored_params_t params) {
+    return compute_call<CallState>(f, std::move(params), std::make_index_sequence<std::tuple_size_v<typename CallState::params_t>>());
+}
+
+
+template<typename CallState, typename F>
+std::vector<CallState> compute_each(F &f, const std::vector<typename CallState::stored_params_t> &misses) {
+    std::vector<CallState> calls;
+    calls.reserve(misses.size());
+    for(const auto &params : misses)
+        calls.push_back(compute_call<CallState>(f, params));
+    return calls;
+}
+
+
+// f_batch(misses) returns a container of the results, in the same order
+template<typename CallState, typename FBatch>
+std::vector<CallState> compute_batch(FBatch &f_batch, const std::vector<typename CallState::stored_params_t> &misses) {
+    auto results = f_batch(misses);
+    if(results.size() != misses.size())
+        throw std::length_error("f_batch returned " + std::to_string(results.size()) + " results for " + std::to_string(misses.size()) + " calls");
+
+    std::vector<CallState> calls;
+    calls.reserve(misses.size());
+    auto result = std::begin(results);
+    for(const auto &params : misses) {
+        calls.push_back(std::apply([&](const auto&... param) { return CallState(std::move(*result), param...); }, params));
+        ++result;
+    }
+    return calls;
+}
+
+
+// the first exception thrown is rethrown (see parallel_for.hpp)
+template<typename CallState, typename F>
+std::vector<CallState> compute_fan_out(F &f, const std::vector<typename CallState::stored_params_t> &misses, std::size_t threads) {
+    if(std::min(threads, misses.size()) <= 1)
+        return compute_each<CallState>(f, misses);
+
+    std::vector<std::optional<CallState>> slots(misses.size());
+    parallel_for(misses.size(), [&](std::size_t i) { slots[i].emplace(compute_call<CallState>(f, misses[i])); }, threads);
+
+    std::vector<CallState> calls;
+    calls.reserve(misses.size());
+    for(std::optional<CallState> &slot : slots)
+        calls.push_back(std::move(*slot));
+    return calls;
+}
+
+
+/* find(hash, key) returns the cached value of key, if any. compute(misses) returns the call_states of the
+ * distinct keys which weren't found, and insert(hash, call_state) caches one of them.
+ */
+template<typename CallState, typename Keys, typename Find, typename Compute, typename Insert>
+std::vector<many_value_t<CallState>> get_many(const Keys &keys, Find &&find, Compute &&compute, Insert &&insert) {
+    using params_t = typename CallState::stored_params_t;
+
+    std::vector<std::optional<many_value_t<CallState>>> results;
+    std::vector<params_t> misses;
+    std::vector<std::uint64_t> miss_hashes;
+    std::vector<std::size_t> miss_of;   // for each key, which miss it is, if it is one
+    std::unordered_multimap<std::uint64_t, std::size_t> miss_index;
+
+    constexpr std::size_t not_missed = SIZE_MAX;
+    for(const auto &key : keys) {
+        std::uint64_t hash = hash_params<params_t>(key);
+        results.push_back(find(hash, key));
+        miss_of.push_back(not_missed);
+        if(results.back())
+            continue;
+
+        // the same key may be asked for more than once
+        auto [first, last] = miss_index.equal_range(hash);
+        auto same = std::find_if(first, last, [&](const auto &miss) { return misses[miss.second] == key; });
+        if(same != last) {
+            miss_of.back() = same->second;
+        } else {
+            miss_of.back() = misses.size();
+            miss_index.emplace(hash, misses.size());
+            misses.emplace_back(key);
+            miss_hashes.push_back(hash);
+        }
+    }
+
+    if(!misses.empty()) {
+        std::vector<CallState> calls = compute(misses);
+        for(std::size_t i = 0; i < results.size(); ++i)
+            if(miss_of[i] != not_missed)
+                results[i].emplace(calls[miss_of[i]].get_return_value());
+        for(std::size_t i = 0; i < calls.size(); ++i)
+            insert(miss_hashes[i], std::move(calls[i]));
+    }
+
+    std::vector<many_value_t<CallState>> values;
+    values.reserve(results.size());
+    for(auto &result : results)
+        values.push_back(std::move(*result));
+    return values;
+}
+
+
+} // namespace detail
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef LIPH_CACHE_STATS_HPP
+#define LIPH_CACHE_STATS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+struct cache_stats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t evictions = 0;        // calls removed to make room
+    std::uint64_t expiries = 0;         // calls removed because they were too old
+    std::chrono::nanoseconds time_in_f{0};  // spent computing misses
+
+    double hit_rate() const { return hits + misses ? static_cast<double>(hits) / static_cast<double>(hits + misses) : 0.0; }
+};
+
+
+namespace detail {
+
+
+inline std::uint64_t mix_hash(std::uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+
+// only one thread adds to a counter at a time (for concurrent_cached_function, the one holding the shard's
+// lock), so it's a plain load and store rather than a locked add, but any thread may read it
+class stat_counter {
+public:
+    stat_counter() = default;
+    stat_counter(const stat_counter &other) : value(other.get()) {}
+
+    stat_counter &operator=(const stat_counter &other) {
+        value.store(other.get(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    void add(std::uint64_t n = 1) { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    std::uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<std::uint64_t> value{0};
+};
+
+
+// the counters kept by the cached_functions themselves (evictions and expiries are usually kept by the table)
+struct call_counters {
+    void add_to(cache_stats &stats) const {
+        stats.hits += hits.get();
+        stats.misses += misses.get();
+        stats.evictions += evictions.get();
+        stats.time_in_f += std::chrono::nanoseconds(nanoseconds_in_f.get());
+    }
+
+    // times f, for misses
+    template<typename F>
+    decltype(auto) timed(F &&f) {
+        struct timer {
+            ~timer() { counter.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()); }
+            stat_counter &counter;
+            std::chrono::steady_clock::time_point start;
+        } t{nanoseconds_in_f, std::chrono::steady_clock::now()};
+        return f();
+    }
+
+    stat_counter hits;
+    stat_counter misses;
+    stat_counter evictions;
+    stat_counter nanoseconds_in_f;
+};
+
+
+
+// estimates how often each hash has been added, never underestimating. each add only increments the
+// smallest of the hash's counters (a conservative update), which keeps the overestimates down.
+class count_min_sketch {
+public:
+    static constexpr std::size_t depth = 4;
+
+    explicit count_min_sketch(std::size_t width) {
+        std::size_t size = 64;
+        while(size < width)
+            size *= 2;
+        counts.assign(size * depth, 0);
+        mask = size - 1;
+    }
+
+    // returns the new estimate
+    std::uint32_t add(std::uint64_t hash) {
+        std::uint32_t estimate = (*this)[hash];
+        if(estimate == UINT32_MAX)
+            return estimate;
+
+        for(std::size_t row = 0; row < depth; ++row) {
+            std::uint32_t &count = counts[slot(row, hash)];
+            if(count == estimate)
+                ++count;
+        }
+        return estimate + 1;
+    }
+
+    std::uint32_t operator[](std::uint64_t hash) const {
+        std::uint32_t estimate = UINT32_MAX;
+        for(std::size_t row = 0; row < depth; ++row)
+            estimate = std::min(estimate, counts[slot(row, hash)]);
+        return estimate;
+    }
+
+    // ages the counts, so that what was popular a while ago gives way to what's popular now
+    void halve() {
+        for(std::uint32_t &count : counts)
+            count /= 2;
+    }
+
+private:
+    std::size_t slot(std::size_t row, std::uint64_t hash) const {
+        return row * (mask + 1) + (mix_hash(hash + row * 0x9e3779b97f4a7c15ULL) & mask);
+    }
+
+    std::vector<std::uint32_t> counts;
+    std::size_t mask;
+};
+
+
+
+/* Every sample_every'th lookup is added to a count-min sketch, and the k keys with the highest estimates are
+ * kept alongside it. k is expected to be small, so the top keys are searched linearly rather than kept in a
+ * heap, which would need to be fixed up whenever the count of a key already in it goes up.
+ */
+template<typename Key>
+class hot_key_tracker {
+    struct hot_key {
+        std::uint64_t hash;
+        Key key;
+        std::uint64_t count;
+    };
+
+public:
+    hot_key_tracker(std::size_t k, std::size_t sample_every)
+        : sketch(std::max<std::size_t>(k * 64, 1024)), k(k), sample_every(std::max<std::size_t>(sample_every, 1)), lookups(0) {}
+
+    template<typename Args>
+    void record(std::uint64_t hash, const Args &args) {
+        if(++lookups % sample_every != 0 || k == 0)
+            return;
+
+        std::uint64_t count = sketch.add(hash);
+        for(hot_key &top : tops) {
+            if(top.hash == hash && top.key == args) {
+                top.count = count;
+                return;
+            }
+        }
+
+        if(tops.size() < k) {
+            tops.push_back({hash, Key(args), count});
+            return;
+        }
+
+        auto coldest = std::min_element(tops.begin(), tops.end(), [](const hot_key &a, const hot_key &b) { return a.count < b.count; });
+        if(count > coldest->count)
+            *coldest = {hash, Key(args), count};
+    }
+
+    // the estimated number of lookups of each key, scaled up by the sampling rate
+    template<typename Out>
+    void report(Out &out) const {
+        for(const hot_key &top : tops)
+            out.emplace_back(top.key, top.count * sample_every);
+    }
+
+    std::size_t size() const { return k; }
+
+private:
+    count_min_sketch sketch;
+    std::size_t k;
+    std::size_t sample_every;
+    std::size_t lookups;
+    std::vector<hot_key> tops;
+};
+
+
+// the hottest k of the keys reported by each tracker, most looked up first
+template<typename Key>
+void keep_hottest(std::vector<std::pair<Key, std::uint64_t>> &keys, std::size_t k) {
+    std::sort(keys.begin(), keys.end(), [](const auto &a, const auto &b) { return a.second > b.second; });
+    if(keys.size() > k)
+        keys.erase(keys.begin() + k, keys.end());
+}
+
+
+} // namespace detail
+
+#endif
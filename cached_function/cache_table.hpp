@@ -0,0 +1,631 @@
+#ifndef LIPH_CACHE_TABLE_HPP
+#define LIPH_CACHE_TABLE_HPP
+
+#include "cache_stats.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace cache_policy {
+
+struct generations {};  // the two std::set generations: when the newer one fills up, the older one is dropped
+struct clock {};        // a hash table, evicting with CLOCK (second chance)
+struct slru {};         // a hash table, evicting with segmented LRU
+struct tinylfu {};      // a hash table, evicting with segmented LRU behind a small window and a frequency filter (W-TinyLFU)
+
+} // namespace cache_policy
+
+
+namespace detail {
+
+
+// hashes an argument as the type it's stored as
+template<typename Stored>
+struct param_hash : std::hash<Stored> {};
+
+// as a std::string_view, which hashes the same as the std::string, so a const char * or std::string_view
+// argument isn't copied into a std::string just to be hashed
+template<typename Char, typename Traits, typename Alloc>
+struct param_hash<std::basic_string<Char, Traits, Alloc>> {
+    std::size_t operator()(std::basic_string_view<Char, Traits> value) const { return std::hash<std::basic_string_view<Char, Traits>>{}(value); }
+};
+
+// so that the hash of the arguments matches the hash of the stored parameters
+template<typename Stored, typename Params, std::size_t... Is>
+std::uint64_t hash_params(const Params &params, std::index_sequence<Is...>) {
+    std::uint64_t hash = 0;
+    ((hash = mix_hash(hash ^ param_hash<std::tuple_element_t<Is, Stored>>{}(std::get<Is>(params)))), ...);
+    return hash;
+}
+
+template<typename Stored, typename Params>
+std::uint64_t hash_params(const Params &params) {
+    return hash_params<Stored>(params, std::make_index_sequence<std::tuple_size_v<Stored>>());
+}
+
+// whether every stored parameter can be hashed
+template<typename Stored>
+struct params_hashable;
+
+template<typename... Ts>
+struct params_hashable<std::tuple<Ts...>> : std::bool_constant<(std::is_invocable_v<param_hash<Ts>, const Ts&> && ...)> {};
+
+
+template<typename T, typename = std::void_t<>>
+constexpr bool has_capacity = false;
+
+template<typename T>
+constexpr bool has_capacity<T, std::void_t<decltype(std::declval<const T&>().capacity()), typename T::value_type>> = true;
+
+template<typename T, typename = std::void_t<>>
+constexpr bool is_range = false;
+
+template<typename T>
+constexpr bool is_range<T, std::void_t<decltype(std::begin(std::declval<const T&>())), decltype(std::declval<const T&>().size())>> = true;
+
+template<typename T>
+constexpr bool is_tuple_like = false;
+
+template<typename... Ts>
+constexpr bool is_tuple_like<std::tuple<Ts...>> = true;
+
+template<typename T, typename U>
+constexpr bool is_tuple_like<std::pair<T, U>> = true;
+
+
+// the memory owned by value, besides sizeof(value): the capacity of containers (including std::string,
+// even when the characters fit in the small string buffer), a guess of two pointers per node for other
+// containers, and what the elements own in turn
+template<typename T>
+std::size_t heap_bytes(const T &value) {
+    if constexpr(is_tuple_like<T>) {
+        return std::apply([](const auto&... member) { return (std::size_t(0) + ... + heap_bytes(member)); }, value);
+    } else if constexpr(is_range<T>) {
+        using element_t = std::decay_t<decltype(*std::begin(value))>;
+
+        std::size_t bytes;
+        if constexpr(has_capacity<T>)
+            bytes = value.capacity() * sizeof(typename T::value_type);
+        else
+            bytes = value.size() * (sizeof(element_t) + 2 * sizeof(void*));
+
+        if constexpr(!std::is_trivially_copyable_v<element_t>)
+            for(const auto &element : value)
+                bytes += heap_bytes(element);
+        return bytes;
+    } else {
+        return 0;
+    }
+}
+
+template<typename T>
+std::size_t estimate_bytes(const T &value) { return sizeof(T) + heap_bytes(value); }
+
+
+
+/* Holds up to capacity() call_states. The call_states live in an array of nodes, and an open-addressing
+ * index (linear probing, at most half full, with backward-shift deletion) maps the hash of the parameters to
+ * the node. When a byte budget is set, the table also keeps the sum of measure(entry) of its entries under it.
+ * Once full, each insert evicts as few nodes as it needs to:
+ *
+ *   cache_policy::clock: a hand sweeps over the nodes, clearing their referenced bits, and evicts the first
+ *       node which hasn't been referenced since the hand last passed it.
+ *   cache_policy::slru: new nodes go on a probationary list, and are moved to a protected list (of up to 80%
+ *       of the capacity) when they're looked up again. nodes pushed out of the protected list go back to the
+ *       front of the probationary list, and the least recently used probationary node is evicted.
+ *   cache_policy::tinylfu: new nodes go on a window list of 1% of the capacity, and the rest is an slru. when
+ *       room is needed, the node leaving the window is only let into the slru if it has been looked up more
+ *       often than the node the slru would evict, so a scan of keys looked up once can't flush out the hot
+ *       ones. how often each hash has been looked up is estimated by a count-min sketch, which is halved
+ *       after 10 lookups per entry of capacity, so that old popularity fades.
+ *
+ * With set_expiry(ttl, stale_for, clock), entries expire ttl after they're added. For stale_for after that,
+ * they're still found, but the first find asks for the entry to be refreshed. After that, they're removed,
+ * either when they're looked up, or by the sweep over a couple of nodes on each insert.
+ * Entries added while expiry is off never expire.
+ */
+template<typename Entry, typename Policy>
+class cache_table {
+    static constexpr std::uint32_t none = UINT32_MAX;
+    static constexpr std::size_t sweep_count = 2;
+    static constexpr bool segmented = std::is_same_v<Policy, cache_policy::slru> || std::is_same_v<Policy, cache_policy::tinylfu>;
+
+    enum segment_t : std::uint8_t { in_window, in_probation, in_protected };
+
+public:
+    using clock_type = std::chrono::steady_clock;
+
+private:
+    // when an entry added while expiry was off expires
+    static constexpr clock_type::time_point never = clock_type::time_point::max();
+
+    struct node {
+        std::optional<Entry> entry;
+        std::uint64_t hash = 0;
+        std::size_t bytes = 0;
+        clock_type::time_point expires = never;
+        bool refreshing = false;
+        bool referenced = false;
+        segment_t segment = in_probation;
+        std::uint32_t prev = none;
+        std::uint32_t next = none;
+    };
+
+    struct list {
+        std::uint32_t head = none;
+        std::uint32_t tail = none;
+        std::size_t size = 0;
+    };
+
+public:
+    explicit cache_table(std::size_t capacity) { reset(capacity); }
+
+    std::size_t size() const { return count; }
+    std::size_t capacity() const { return max_nodes; }
+    std::size_t current_bytes() const { return total_bytes; }
+
+    // f(entry, time_left), where time_left is how long the entry has until it expires (negative once it's
+    // stale), or empty if expiry is off or the entry was added while it was
+    template<typename F>
+    void for_each(F &&f) const {
+        std::optional<clock_type::time_point> now;
+        if(clock)
+            now = clock();
+
+        for(const node &n : nodes)
+            if(n.entry)
+                f(*n.entry, now && n.expires != never ? std::optional<clock_type::duration>(n.expires - *now) : std::nullopt);
+    }
+
+    // the evictions and expiries
+    void add_to(cache_stats &stats) const {
+        stats.evictions += evictions.get();
+        stats.expiries += expiries.get();
+    }
+
+    // marks the entry as used
+    template<typename Key>
+    Entry *find(std::uint64_t hash, const Key &key) { return find_entry(hash, key, nullptr); }
+
+    // refresh is set if the entry is stale, and no refresh has been asked for yet
+    template<typename Key>
+    Entry *find(std::uint64_t hash, const Key &key, bool &refresh) {
+        refresh = false;
+        return find_entry(hash, key, &refresh);
+    }
+
+    // whether the key is in the table, without counting it as a lookup or marking its entry as used, for
+    // checking before an insert
+    template<typename Key>
+    bool contains(std::uint64_t hash, const Key &key) {
+        clock_type::time_point now;
+        return live_node(hash, key, now) != none;
+    }
+
+    // the key must not already be in the table. returns the added entry, or null if it could never fit, in
+    // which case entry isn't moved from.
+    Entry *insert(std::uint64_t hash, Entry &&entry) {
+        clock_type::time_point expires = never;
+        if(clock) {
+            clock_type::time_point now = clock();
+            sweep(now);
+            expires = now + ttl;
+        }
+        return add(hash, std::move(entry), expires);
+    }
+
+    // like insert, but the entry expires after time_left (if there is one) instead of the time to live. an
+    // entry which would already be too stale to be found isn't added, and null is returned.
+    Entry *insert(std::uint64_t hash, Entry &&entry, std::optional<clock_type::duration> time_left) {
+        if(!clock || !time_left)
+            return insert(hash, std::move(entry));
+        if(*time_left + stale_for <= clock_type::duration::zero())
+            return nullptr;
+
+        clock_type::time_point now = clock();
+        sweep(now);
+        return add(hash, std::move(entry), now + *time_left);
+    }
+
+    // replaces the entry with the same parameters as entry, or adds it if it has been removed since
+    void replace(std::uint64_t hash, Entry entry) {
+        std::uint32_t n = index[find_slot(hash, entry.params)];
+        if(n != none)
+            remove(n);
+        insert(hash, std::move(entry));
+    }
+
+    // lets the entry be refreshed again, after a refresh failed
+    template<typename Key>
+    void cancel_refresh(std::uint64_t hash, const Key &key) {
+        std::uint32_t n = index[find_slot(hash, key)];
+        if(n != none)
+            nodes[n].refreshing = false;
+    }
+
+    void clear() { reset(max_nodes); }
+
+    // the least valuable entries are evicted when shrinking. the rest keep their place in the lists, except
+    // that whatever no longer fits in the window or protected list moves to the probationary list.
+    void set_capacity(std::size_t capacity) {
+        while(count > capacity)
+            evict();
+
+        std::vector<node> old;
+        std::swap(old, nodes);
+        list old_lists[] = {window, probation, protected_list};
+        reset(capacity);
+
+        auto readd = [&](std::uint32_t o) {
+            std::uint32_t n = place(old[o].hash, std::move(*old[o].entry), old[o].expires, old[o].bytes);
+            nodes[n].referenced = old[o].referenced;
+            nodes[n].refreshing = old[o].refreshing;
+            return n;
+        };
+
+        if constexpr(segmented) {
+            // least recently used first, so that each list ends up in the same order
+            for(segment_t segment : {in_window, in_probation, in_protected}) {
+                for(std::uint32_t o = old_lists[segment].tail; o != none; o = old[o].prev) {
+                    std::uint32_t n = readd(o);
+                    nodes[n].segment = segment;
+                    link_front(list_of(segment), n);
+                }
+            }
+
+            while(window.size > window_capacity())
+                move_front(probation, in_probation, window.tail);
+            while(protected_list.size > protected_capacity())
+                move_front(probation, in_probation, protected_list.tail);
+        } else {
+            for(std::uint32_t o = 0; o < old.size(); ++o)
+                if(old[o].entry)
+                    readd(o);
+        }
+    }
+
+    // measure(entry) returns the number of bytes entry takes up. every entry is measured again.
+    void set_max_bytes(std::size_t bytes, std::function<std::size_t(const Entry&)> measure_entry) {
+        max_bytes = bytes;
+        measure = std::move(measure_entry);
+
+        total_bytes = 0;
+        for(node &n : nodes) {
+            if(n.entry) {
+                n.bytes = measure(*n.entry);
+                total_bytes += n.bytes;
+            }
+        }
+
+        while(total_bytes > max_bytes)
+            evict();
+    }
+
+    // applies to entries added from now on. an empty now_func turns expiry off.
+    void set_expiry(clock_type::duration time_to_live, clock_type::duration stale, std::function<clock_type::time_point()> now_func) {
+        ttl = time_to_live;
+        stale_for = stale;
+        clock = std::move(now_func);
+    }
+
+private:
+    // a stale entry is only claimed for refreshing if refresh isn't null
+    template<typename Key>
+    Entry *find_entry(std::uint64_t hash, const Key &key, bool *refresh) {
+        if constexpr(std::is_same_v<Policy, cache_policy::tinylfu>) {
+            sketch->add(hash);
+            if(++sketch_additions >= std::max<std::size_t>(max_nodes, 1) * 10) {
+                sketch->halve();
+                sketch_additions /= 2;
+            }
+        }
+
+        clock_type::time_point now;
+        std::uint32_t n = live_node(hash, key, now);
+        if(n == none)
+            return nullptr;
+
+        node &found = nodes[n];
+        if(clock && now >= found.expires && refresh && !found.refreshing) {
+            *refresh = true;
+            found.refreshing = true;
+        }
+
+        touch(n);
+        return &*found.entry;
+    }
+
+    // the node holding key, or none. an entry which is too stale to be found is removed. now is set to the
+    // time it was looked up at, if there's a clock.
+    template<typename Key>
+    std::uint32_t live_node(std::uint64_t hash, const Key &key, clock_type::time_point &now) {
+        std::uint32_t n = index[find_slot(hash, key)];
+        if(n == none || !clock)
+            return n;
+
+        now = clock();
+        if(too_stale(nodes[n], now)) {
+            remove(n);
+            expiries.add();
+            return none;
+        }
+        return n;
+    }
+
+    Entry *add(std::uint64_t hash, Entry &&entry, clock_type::time_point expires) {
+        std::size_t bytes = measure ? measure(entry) : 0;
+        if(max_nodes == 0 || bytes > max_bytes)
+            return nullptr;
+
+        while(count == max_nodes || total_bytes + bytes > max_bytes)
+            evict();
+
+        std::uint32_t n = place(hash, std::move(entry), expires, bytes);
+        node &added = nodes[n];
+        added.refreshing = false;
+        added.referenced = true;
+        if constexpr(std::is_same_v<Policy, cache_policy::slru>) {
+            added.segment = in_probation;
+            link_front(probation, n);
+        } else if constexpr(std::is_same_v<Policy, cache_policy::tinylfu>) {
+            added.segment = in_window;
+            link_front(window, n);
+            // there's room for the node leaving the window, since any room needed was made above
+            if(window.size > window_capacity())
+                move_front(probation, in_probation, window.tail);
+        }
+        return &*added.entry;
+    }
+
+    // puts entry in a free node and indexes it, without making room for it or linking it into a list
+    std::uint32_t place(std::uint64_t hash, Entry &&entry, clock_type::time_point expires, std::size_t bytes) {
+        if((count + 1) * 2 > index.size())
+            grow_index();
+
+        std::uint32_t n;
+        if(!free_nodes.empty()) {
+            n = free_nodes.back();
+            free_nodes.pop_back();
+        } else {
+            n = static_cast<std::uint32_t>(nodes.size());
+            nodes.emplace_back();
+        }
+
+        node &placed = nodes[n];
+        placed.entry.emplace(std::move(entry));
+        placed.hash = hash;
+        placed.bytes = bytes;
+        placed.expires = expires;
+
+        std::size_t slot = hash & mask;
+        while(index[slot] != none)
+            slot = (slot + 1) & mask;
+        index[slot] = n;
+
+        ++count;
+        total_bytes += bytes;
+        return n;
+    }
+
+    void reset(std::size_t capacity) {
+        max_nodes = capacity;
+        nodes.clear();
+        index.assign(16, none);
+        mask = index.size() - 1;
+
+        count = 0;
+        total_bytes = 0;
+        free_nodes.clear();
+        hand = 0;
+        sweep_hand = 0;
+        window = list();
+        probation = list();
+        protected_list = list();
+
+        if constexpr(std::is_same_v<Policy, cache_policy::tinylfu>) {
+            sketch.emplace(std::min<std::size_t>(capacity, std::size_t(1) << 20));
+            sketch_additions = 0;
+        }
+    }
+
+    std::size_t window_capacity() const {
+        if constexpr(std::is_same_v<Policy, cache_policy::tinylfu>)
+            return std::max<std::size_t>(max_nodes / 100, 1);
+        else
+            return 0;
+    }
+
+    std::size_t protected_capacity() const {
+        return std::max<std::size_t>((max_nodes - std::min(window_capacity(), max_nodes)) * 4 / 5, 1);
+    }
+
+    template<typename Key>
+    std::size_t find_slot(std::uint64_t hash, const Key &key) const {
+        std::size_t slot = hash & mask;
+        while(index[slot] != none) {
+            const node &n = nodes[index[slot]];
+            if(n.hash == hash && n.entry->params == key)
+                break;
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    void touch(std::uint32_t n) {
+        if constexpr(std::is_same_v<Policy, cache_policy::clock>) {
+            nodes[n].referenced = true;
+        } else if(nodes[n].segment == in_window) {
+            move_front(window, in_window, n);
+        } else {
+            move_front(protected_list, in_protected, n);
+            if(protected_list.size > protected_capacity())
+                move_front(probation, in_probation, protected_list.tail);
+        }
+    }
+
+    // removes the least valuable entry
+    void evict() {
+        std::uint32_t n;
+        if constexpr(std::is_same_v<Policy, cache_policy::clock>) {
+            for(;;) {
+                n = hand;
+                hand = (hand + 1) % nodes.size();
+                if(!nodes[n].entry)
+                    continue;
+                if(!nodes[n].referenced)
+                    break;
+                nodes[n].referenced = false;
+            }
+        } else if constexpr(std::is_same_v<Policy, cache_policy::slru>) {
+            n = probation.tail != none ? probation.tail : protected_list.tail;
+        } else {
+            // the node leaving the window competes with the slru's victim, and the one looked up less often goes
+            std::uint32_t candidate = window.size >= window_capacity() ? window.tail : none;
+            std::uint32_t victim = probation.tail != none ? probation.tail : protected_list.tail;
+            if(victim == none) {
+                n = window.tail;
+            } else if(candidate == none) {
+                n = victim;
+            } else if((*sketch)[nodes[candidate].hash] > (*sketch)[nodes[victim].hash]) {
+                move_front(probation, in_probation, candidate);
+                n = victim;
+            } else {
+                n = candidate;
+            }
+        }
+        remove(n);
+        evictions.add();
+    }
+
+    bool too_stale(const node &n, clock_type::time_point now) const {
+        return n.expires != never && now >= n.expires + stale_for;
+    }
+
+    // removes entries which are too stale to be returned, from the next few nodes
+    void sweep(clock_type::time_point now) {
+        for(std::size_t i = 0; i < sweep_count && sweep_hand < nodes.size(); ++i) {
+            std::uint32_t n = static_cast<std::uint32_t>(sweep_hand);
+            sweep_hand = (sweep_hand + 1) % nodes.size();
+            if(nodes[n].entry && too_stale(nodes[n], now)) {
+                remove(n);
+                expiries.add();
+            }
+        }
+    }
+
+    void remove(std::uint32_t n) {
+        if constexpr(segmented)
+            unlink(list_of(nodes[n].segment), n);
+
+        std::size_t slot = nodes[n].hash & mask;
+        while(index[slot] != n)
+            slot = (slot + 1) & mask;
+        erase_slot(slot);
+
+        --count;
+        total_bytes -= nodes[n].bytes;
+        nodes[n].entry.reset();
+        free_nodes.push_back(n);
+    }
+
+    void grow_index() {
+        index.assign(index.size() * 2, none);
+        mask = index.size() - 1;
+
+        for(std::uint32_t n = 0; n < nodes.size(); ++n) {
+            if(nodes[n].entry) {
+                std::size_t slot = nodes[n].hash & mask;
+                while(index[slot] != none)
+                    slot = (slot + 1) & mask;
+                index[slot] = n;
+            }
+        }
+    }
+
+    // backward-shift deletion: later entries of the probe sequence are moved up into the hole
+    void erase_slot(std::size_t hole) {
+        for(std::size_t slot = (hole + 1) & mask; index[slot] != none; slot = (slot + 1) & mask) {
+            std::size_t home = nodes[index[slot]].hash & mask;
+            if(((slot - home) & mask) >= ((slot - hole) & mask)) {
+                index[hole] = index[slot];
+                hole = slot;
+            }
+        }
+        index[hole] = none;
+    }
+
+    void link_front(list &l, std::uint32_t n) {
+        nodes[n].prev = none;
+        nodes[n].next = l.head;
+        if(l.head != none)
+            nodes[l.head].prev = n;
+        else
+            l.tail = n;
+        l.head = n;
+        ++l.size;
+    }
+
+    list &list_of(segment_t segment) {
+        return segment == in_window ? window : segment == in_probation ? probation : protected_list;
+    }
+
+    // moves n from whichever list it's in to the front of l
+    void move_front(list &l, segment_t segment, std::uint32_t n) {
+        unlink(list_of(nodes[n].segment), n);
+        nodes[n].segment = segment;
+        link_front(l, n);
+    }
+
+    void unlink(list &l, std::uint32_t n) {
+        node &removed = nodes[n];
+        if(removed.prev != none)
+            nodes[removed.prev].next = removed.next;
+        else
+            l.head = removed.next;
+
+        if(removed.next != none)
+            nodes[removed.next].prev = removed.prev;
+        else
+            l.tail = removed.prev;
+        --l.size;
+    }
+
+    std::vector<node> nodes;
+    std::vector<std::uint32_t> free_nodes;
+    std::vector<std::uint32_t> index;
+    std::size_t mask;
+    std::size_t max_nodes;
+    std::size_t count;
+    std::size_t max_bytes = std::numeric_limits<std::size_t>::max();
+    std::size_t total_bytes;
+    std::function<std::size_t(const Entry&)> measure;
+    stat_counter evictions;
+    stat_counter expiries;
+    std::size_t hand;
+    std::size_t sweep_hand;
+    clock_type::duration ttl{};
+    clock_type::duration stale_for{};
+    std::function<clock_type::time_point()> clock;
+    list window;
+    list probation;
+    list protected_list;
+    std::optional<count_min_sketch> sketch;  // only for cache_policy::tinylfu
+    std::size_t sketch_additions;
+};
+
+
+} // namespace detail
+
+#endif
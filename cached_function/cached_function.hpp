@@ -1,12 +1,22 @@
 #ifndef LIPH_CACHED_FUNCTION_HPP
 #define LIPH_CACHED_FUNCTION_HPP
 
+#include "batch.hpp"
+#include "cache_table.hpp"
+#include "snapshot.hpp"
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <set>
+#include <shared_mutex>
+#include <string>
 #include <utility>
 #include <tuple>
+#include <vector>
 #include <type_traits>
 
 
@@ -43,12 +53,21 @@ struct call_state {
     using stored_return_t = std::conditional_t<std::is_reference_v<R>, std::remove_reference_t<R>*, R>;
     using stored_params_t = std::tuple<decay_no_ref_t<Args>...>;
     
-    template<typename R2, typename... Args2>
-    call_state(R2 &&r, Args2&&... args) : return_value(get_return_value(std::forward<R>(r))), params(std::forward<Args>(args)...) {}
+    // constrained, so that it isn't picked over the copy constructor
+    template<typename R2, typename... Args2, typename = std::enable_if_t<sizeof...(Args2) == sizeof...(Args)>>
+    call_state(R2 &&r, Args2&&... args) : return_value(get_return_value(std::forward<R>(r))), params(std::forward<Args2>(args)...) {}
     
     
     template<typename U = R>
     std::enable_if_t<std::is_reference_v<U>, R> get_return_value() const { return *return_value; }
+
+    // without copying
+    const std::remove_reference_t<R> &return_value_ref() const {
+        if constexpr(std::is_reference_v<R>)
+            return *return_value;
+        else
+            return return_value;
+    }
     
     template<typename U = R>
     std::enable_if_t<!std::is_reference_v<U>, R> get_return_value() const { return return_value; }
@@ -102,10 +121,109 @@ bool operator<(const call_state<R, Args...> &left, const std::tuple<Args2...> &r
 }
 
 
+
+// calls f and returns the call_state of the call. the arguments are converted to the stored parameters first
+// (e.g. a std::string_view passed for a const std::string &), which f is then given (see compute_call).
+template<typename CallState, typename F, typename... Args>
+CallState make_call(F &f, Args&&... args) {
+    return compute_call<CallState>(f, typename CallState::stored_params_t(std::forward<Args>(args)...));
+}
+
+
+template<typename Functor, typename CallState>
+struct shared_results;
+
+template<typename Functor, typename R, typename... Args>
+struct shared_results<Functor, call_state<R, Args...>> {
+    std::shared_ptr<const std::decay_t<R>> operator()(Args... args) { return std::make_shared<const std::decay_t<R>>(f(std::forward<Args>(args)...)); }
+
+    Functor f;
+};
+
+
+struct default_measure {
+    template<typename T>
+    std::size_t operator()(const T &value) const { return estimate_bytes(value); }
+};
+
+// the bytes of a call: the call_state itself, what its parameters own, and measure(return value)
+template<typename CallState, typename Measure>
+std::function<std::size_t(const CallState&)> measure_calls(Measure measure) {
+    return [measure = std::move(measure)](const CallState &call) -> std::size_t {
+        return sizeof(CallState) - sizeof(typename CallState::stored_return_t) + heap_bytes(call.params) + measure(call.return_value_ref());
+    };
+}
+
+
+// the executor may run a refresh task after the cached_function which asked for it has been destroyed, so
+// the tasks share a flag with it, and do nothing once it's cleared. clearing it waits for any task which is
+// already running. a copy (or a moved-to cached_function) has a flag of its own.
+class refresh_guard {
+    struct shared_state {
+        std::shared_mutex mutex;
+        bool alive = true;
+    };
+
+public:
+    refresh_guard() : state(std::make_shared<shared_state>()) {}
+    refresh_guard(const refresh_guard &) : refresh_guard() {}
+    refresh_guard &operator=(const refresh_guard &) { return *this; }
+
+    ~refresh_guard() {
+        std::unique_lock<std::shared_mutex> lock(state->mutex);
+        state->alive = false;
+    }
+
+    template<typename Task>
+    std::function<void()> wrap(Task task) const {
+        return [state = state, task = std::move(task)]() mutable {
+            std::shared_lock<std::shared_mutex> lock(state->mutex);
+            if(state->alive)
+                task();
+        };
+    }
+
+private:
+    std::shared_ptr<shared_state> state;
+};
+
+
+struct expiry_settings {
+    using clock_type = std::chrono::steady_clock;
+
+    clock_type::duration ttl{};
+    clock_type::duration stale_for{};
+    std::function<clock_type::time_point()> now;
+    std::function<void(std::function<void()>)> executor;
+    refresh_guard guard;  // declared after the table in the cached_functions, so that it's destroyed first
+
+    template<typename Table>
+    void apply(Table &table) const { table.set_expiry(ttl, executor ? stale_for : clock_type::duration::zero(), now); }
+
+    // task may refer to the cached_function, since it isn't run once that's been destroyed
+    template<typename Task>
+    void refresh(Task task) const { executor(guard.wrap(std::move(task))); }
+};
+
+
 } // namespace detail
 
 
 
+/* share_results(f) returns a functor which returns a std::shared_ptr<const R> to what f returns, so that a
+ * cached_function of it only copies the std::shared_ptr on a hit, however big the result is:
+ *
+ *     cached_function<shared_results_t<image(*)(const std::string&)>, cache_policy::clock> load(1000, share_results(load_image));
+ *     std::shared_ptr<const image> i = load("cat.png");
+ */
+template<typename Functor>
+using shared_results_t = detail::shared_results<Functor, decltype(detail::make_call_state(std::declval<Functor>()))>;
+
+template<typename Functor>
+shared_results_t<Functor> share_results(Functor f) { return {std::move(f)}; }
+
+
+
 template<typename Functor>
 class basic_cached_function {
     using call_state_t = decltype(detail::make_call_state(std::declval<Functor>()));
@@ -117,57 +235,267 @@ public:
     typename call_state_t::return_t operator()(Args&&... args) {
         std::tuple<Args&&...> arg_refs{std::forward<Args>(args)...};
         
-        if(!last_call || last_call->params != arg_refs)
-            last_call.emplace(f(std::forward<Args>(args)...), std::forward<Args>(args)...);
+        if(!last_call || last_call->params != arg_refs) {
+            counters.misses.add();
+            if(last_call)
+                counters.evictions.add();
+            last_call.emplace(counters.timed([&] { return detail::make_call<call_state_t>(f, std::forward<Args>(args)...); }));
+        } else {
+            counters.hits.add();
+        }
             
         return last_call->get_return_value();
     }
+
+    cache_stats stats() const {
+        cache_stats result;
+        counters.add_to(result);
+        return result;
+    }
     
 private:
     Functor f;
     std::optional<call_state_t> last_call;
+    detail::call_counters counters;
 };
 
 
 
-template<typename Functor>
+/* cached_function<Functor, cache_policy::clock>, cache_policy::slru and cache_policy::tinylfu keep up to max
+ * calls in a hash table (see cache_table.hpp), so every parameter type needs a std::hash specialization.
+ * Lookups and inserts are O(1), and once the table is full each new call evicts a single old one, rather than
+ * a whole generation at a time. cache_policy::tinylfu only keeps a new call if its parameters have been looked
+ * up more often than those of the call it would evict, so it holds on to the hot calls through long scans.
+ * std::string parameters are hashed as std::string_views, so looking one up by a const char * or a
+ * std::string_view doesn't allocate (f is called with a std::string made from it, on a miss).
+ *
+ * get_ref(args...) returns a const reference to the cached return value rather than a copy. It stays valid
+ * until the cached_function is next used (this is true of the generational cached_function, too).
+ *
+ * set_max_bytes(bytes) also limits the estimated memory of the cached calls. By default, a return value is
+ * estimated as its sizeof plus the capacity of any containers in it (see detail::heap_bytes), which can be
+ * replaced with set_max_bytes(bytes, measure), where measure(return value) returns its size in bytes:
+ *
+ *     cached_function<image(*)(const std::string&), cache_policy::clock> load(1000000, load_image);
+ *     load.set_max_bytes(512 << 20, [](const image &i) { return sizeof(image) + i.pixels.size() * 4; });
+ *
+ * set_time_to_live(ttl) makes calls cached from then on be recomputed once they're older than ttl (calls
+ * cached before it's first set never expire). Expired calls are found when they're looked up, or a couple at a
+ * time when calls are added; there are no timers. The clock can be replaced with set_time_to_live(ttl, now),
+ * where now() returns a std::chrono::steady_clock::time_point.
+ *
+ * set_stale_while_revalidate(stale_for, executor) keeps returning an expired call for up to stale_for, while
+ * it's recomputed by a task passed to executor(std::function<void()>). The task must run on a thread which
+ * is allowed to call the cached_function (for cached_function, usually the same thread, e.g. from an event
+ * loop). A task which runs after the cached_function has been destroyed does nothing. If f throws while
+ * refreshing, the exception is dropped, and the next lookup asks for another refresh.
+ *
+ * stats() returns the number of hits, misses, evictions and expiries so far, and the time spent in f.
+ * After track_hot_keys(k, sample_every), every sample_every'th lookup is counted in a count-min sketch, and
+ * hot_keys() returns the (about) k most looked up parameters, with an estimate of how often they were.
+ *
+ * save(path) writes the cached calls to a snapshot file, and load(path) adds the calls from one (see
+ * snapshot.hpp for which types can be saved), so a restarted process doesn't start with an empty cache:
+ *
+ *     try { prices.load("prices.cache"); } catch(const std::runtime_error &) {}
+ *     ...
+ *     prices.save("prices.cache");
+ *
+ * get_many(keys) looks up a range of std::tuples of arguments, and returns a std::vector of the results in
+ * the same order (with std::reference_wrappers for functions returning references). The distinct misses are
+ * computed after all the lookups, either by calling f for each, by calling f_batch(misses) once with a
+ * std::vector of the missing parameter tuples (get_many(keys, f_batch), where f_batch returns a container of
+ * the results in the same order), or by calling f on several threads (get_many(keys, fan_out{threads})).
+ */
+template<typename Functor, typename Policy = cache_policy::generations>
 class cached_function {
     using call_state_t = decltype(detail::make_call_state(std::declval<Functor>()));
-    using call_set = std::set<call_state_t, std::less<>>;
+    using stored_params_t = typename call_state_t::stored_params_t;
 
 public:
-    cached_function(std::size_t max, Functor f) : max_size(max / 2), f(std::move(f)) {}
-    cached_function(Functor f) : f(std::move(f)) {}
-    
+    cached_function(std::size_t max, Functor f) : f(std::move(f)), calls(max) {}
+    cached_function(Functor f) : cached_function(50, std::move(f)) {}
+
     template<typename... Args>
-    typename call_state_t::return_t operator()(Args&&... args) {
+    typename call_state_t::return_t operator()(Args&&... args) { return find_or_call(std::forward<Args>(args)...).get_return_value(); }
+
+    // returns the cached return value without copying it, which stays valid until the cached_function is next
+    // used
+    template<typename... Args>
+    const std::remove_reference_t<typename call_state_t::return_t> &get_ref(Args&&... args) {
+        return find_or_call(std::forward<Args>(args)...).return_value_ref();
+    }
+
+    void set_max_size(std::size_t max) { calls.set_capacity(max); }
+
+    void set_max_bytes(std::size_t bytes) { set_max_bytes(bytes, detail::default_measure()); }
+
+    template<typename Measure>
+    void set_max_bytes(std::size_t bytes, Measure measure) {
+        calls.set_max_bytes(bytes, detail::measure_calls<call_state_t>(std::move(measure)));
+    }
+
+    void set_time_to_live(std::chrono::steady_clock::duration ttl, std::function<std::chrono::steady_clock::time_point()> now = std::chrono::steady_clock::now) {
+        expiry.ttl = ttl;
+        expiry.now = std::move(now);
+        expiry.apply(calls);
+    }
+
+    void set_stale_while_revalidate(std::chrono::steady_clock::duration stale_for, std::function<void(std::function<void()>)> executor) {
+        expiry.stale_for = stale_for;
+        expiry.executor = std::move(executor);
+        expiry.apply(calls);
+    }
+
+    void expire_all() { calls.clear(); }
+
+    std::size_t size() const { return calls.size(); }
+    std::size_t current_bytes() const { return calls.current_bytes(); }
+
+    cache_stats stats() const {
+        cache_stats result;
+        counters.add_to(result);
+        calls.add_to(result);
+        return result;
+    }
+
+    void track_hot_keys(std::size_t k, std::size_t sample_every = 16) { hot.emplace(k, sample_every); }
+
+    template<typename Keys>
+    std::vector<detail::many_value_t<call_state_t>> get_many(const Keys &keys) {
+        return get_many_with(keys, [this](const auto &misses) { return detail::compute_each<call_state_t>(f, misses); });
+    }
+
+    template<typename Keys, typename FBatch>
+    std::vector<detail::many_value_t<call_state_t>> get_many(const Keys &keys, FBatch f_batch) {
+        return get_many_with(keys, [&](const auto &misses) { return detail::compute_batch<call_state_t>(f_batch, misses); });
+    }
+
+    template<typename Keys>
+    std::vector<detail::many_value_t<call_state_t>> get_many(const Keys &keys, fan_out parallel) {
+        return get_many_with(keys, [&](const auto &misses) { return detail::compute_fan_out<call_state_t>(f, misses, parallel.threads); });
+    }
+
+    void save(const std::string &path) const {
+        detail::save_snapshot<call_state_t>(path, [this](auto &&write) { calls.for_each(write); });
+    }
+
+    // returns the number of calls in the snapshot. if there are more than fit, the last ones are kept.
+    std::size_t load(const std::string &path) {
+        return detail::load_snapshot<call_state_t>(path, [this](call_state_t call, auto time_left) {
+            std::uint64_t hash = detail::hash_params<stored_params_t>(call.params);
+            if(!calls.contains(hash, call.params))
+                calls.insert(hash, std::move(call), time_left);
+        });
+    }
+
+    std::vector<std::pair<stored_params_t, std::uint64_t>> hot_keys() const {
+        std::vector<std::pair<stored_params_t, std::uint64_t>> keys;
+        if(hot) {
+            hot->report(keys);
+            detail::keep_hottest(keys, hot->size());
+        }
+        return keys;
+    }
+
+private:
+    template<typename... Args>
+    const call_state_t &find_or_call(Args&&... args) {
         std::tuple<Args&&...> arg_refs{std::forward<Args>(args)...};
-        
-        auto it = new_calls.find(arg_refs);
+        std::uint64_t hash = detail::hash_params<stored_params_t>(arg_refs);
+
+        if(hot)
+            hot->record(hash, arg_refs);
+
+        bool refresh;
+        if(call_state_t *call = calls.find(hash, arg_refs, refresh)) {
+            counters.hits.add();
+            if(!refresh)
+                return *call;
+
+            // the executor may run the refresh right away, which replaces call
+            call_state_t stale = *call;
+            revalidate(hash, stored_params_t(stale.params));
+            return uncached.emplace(std::move(stale));
+        }
+
+        // f may call this cached_function recursively, so nothing is held on to while it runs
+        counters.misses.add();
+        call_state_t call = counters.timed([&] { return detail::make_call<call_state_t>(f, std::forward<Args>(args)...); });
+        if(call_state_t *added = calls.insert(hash, std::move(call)))
+            return *added;
+        return uncached.emplace(std::move(call));  // call is only moved from if it's added
+    }
 
-        bool in_new = (it != new_calls.end());
-        if(!in_new)
-            it = old_calls.find(arg_refs);
+    template<typename Keys, typename Compute>
+    std::vector<detail::many_value_t<call_state_t>> get_many_with(const Keys &keys, Compute &&compute) {
+        return detail::get_many<call_state_t>(keys,
+            [this](std::uint64_t hash, const auto &key) -> std::optional<detail::many_value_t<call_state_t>> {
+                if(call_state_t *call = calls.find(hash, key)) {
+                    counters.hits.add();
+                    return call->get_return_value();
+                }
+                counters.misses.add();
+                return {};
+            },
+            [&](const auto &misses) { return counters.timed([&] { return compute(misses); }); },
+            [this](std::uint64_t hash, call_state_t call) {
+                if(!calls.contains(hash, call.params))
+                    calls.insert(hash, std::move(call));
+            });
+    }
 
-        if(!in_new && it == old_calls.end()) {  // if not in either
-            call_state_t call(f(std::forward<Args>(args)...), std::forward<Args>(args)...);
+    void revalidate(std::uint64_t hash, stored_params_t params) {
+        expiry.refresh([this, hash, params = std::move(params)] {
+            try {
+                calls.replace(hash, detail::compute_call<call_state_t>(f, params));
+            } catch(...) {
+                calls.cancel_refresh(hash, params);
+            }
+        });
+    }
 
-            if(fill_new())
-                it = new_calls.insert(std::move(call)).first;
-            else
-                it = old_calls.insert(std::move(call)).first;
-        } else if(!in_new && fill_new()) {
-            // if call needs to be moved from old to new
-            call_state_t call = std::move(old_calls.extract(it).value());
-            it = new_calls.insert(std::move(call)).first;
-        } // if in new, do nothing. (or in old and doesn't need to be moved) just return it
-            
-        auto ret = it->get_return_value();
+    Functor f;
+    detail::cache_table<call_state_t, Policy> calls;
+    detail::expiry_settings expiry;
+    detail::call_counters counters;
+    std::optional<detail::hot_key_tracker<stored_params_t>> hot;
+    std::optional<call_state_t> uncached;   // what get_ref refers to, for a call which isn't in the table
+};
 
-        if(new_calls.size() > max_size)
-            expire();
 
-        return ret;
+
+/* The default cached_function, cache_policy::generations, keeps the calls in two std::sets: new calls go into
+ * the newer one, and once that holds half of max calls, the older one is dropped and the newer one becomes the
+ * older one. A call found in the older one is moved to the newer one.
+ *
+ * set_max_bytes(bytes) also limits each generation to bytes / 2, estimated as for the hashed cached_function.
+ *
+ * track_hot_keys and hot_keys work as for the hashed cached_function, but need the parameters to be hashable.
+ * save and load work as for the hashed cached_function too. The calls in a snapshot don't expire once loaded,
+ * except that calls which had already expired when they were loaded are skipped.
+ *
+ * A call has nowhere to keep when it expires, so set_time_to_live and set_stale_while_revalidate don't compile
+ * for it; use one of the hashed policies for calls which go out of date.
+ */
+template<typename Functor>
+class cached_function<Functor, cache_policy::generations> {
+    using call_state_t = decltype(detail::make_call_state(std::declval<Functor>()));
+    using stored_params_t = typename call_state_t::stored_params_t;
+    using call_set = std::set<call_state_t, std::less<>>;
+
+public:
+    cached_function(std::size_t max, Functor f) : max_size(max / 2), f(std::move(f)) {}
+    cached_function(Functor f) : f(std::move(f)) {}
+    
+    template<typename... Args>
+    typename call_state_t::return_t operator()(Args&&... args) { return find_or_call(std::forward<Args>(args)...).get_return_value(); }
+
+    // returns the cached return value without copying it, which stays valid until the cached_function is next
+    // used
+    template<typename... Args>
+    const std::remove_reference_t<typename call_state_t::return_t> &get_ref(Args&&... args) {
+        return find_or_call(std::forward<Args>(args)...).return_value_ref();
     }
 
     void set_max_size(std::size_t max) {
@@ -177,26 +505,198 @@ public:
             expire();
     }
 
+    void set_max_bytes(std::size_t bytes) { set_max_bytes(bytes, detail::default_measure()); }
+
+    // every call is measured again, and if they're over the budget, the older calls are dropped, and then
+    // the newer ones, if they're still over it
+    template<typename Measure>
+    void set_max_bytes(std::size_t bytes, Measure measure_return) {
+        max_bytes = bytes;
+        measure = detail::measure_calls<call_state_t>(std::move(measure_return));
+        new_bytes = measure_all(new_calls);
+        old_bytes = measure_all(old_calls);
+
+        if(new_bytes + old_bytes > max_bytes)
+            expire();
+        if(old_bytes > max_bytes)
+            expire();
+    }
+
+    template<typename... Args>
+    void set_time_to_live(Args&&...) {
+        static_assert(false && sizeof...(Args), "set_time_to_live needs a hashed cache_policy (clock, slru or tinylfu)");
+    }
+
+    template<typename... Args>
+    void set_stale_while_revalidate(Args&&...) {
+        static_assert(false && sizeof...(Args), "set_stale_while_revalidate needs a hashed cache_policy (clock, slru or tinylfu)");
+    }
+
     void expire_all() {
         new_calls.clear();
         old_calls.clear();
+        new_bytes = old_bytes = 0;
     }
    
     // only leave the most recent calls 
     void expire() {
+        counters.evictions.add(old_calls.size());
         old_calls.clear();
         std::swap(old_calls, new_calls);
+        old_bytes = std::exchange(new_bytes, 0);
+    }
+
+    std::size_t current_bytes() const { return new_bytes + old_bytes; }
+
+    // expiries are always 0, since calls don't expire
+    cache_stats stats() const {
+        cache_stats result;
+        counters.add_to(result);
+        return result;
+    }
+
+    void track_hot_keys(std::size_t k, std::size_t sample_every = 16) {
+        static_assert(detail::params_hashable<stored_params_t>::value, "track_hot_keys needs parameters which can be hashed");
+        hot.emplace(k, sample_every);
+    }
+
+    std::vector<std::pair<stored_params_t, std::uint64_t>> hot_keys() const {
+        std::vector<std::pair<stored_params_t, std::uint64_t>> keys;
+        if(hot) {
+            hot->report(keys);
+            detail::keep_hottest(keys, hot->size());
+        }
+        return keys;
+    }
+
+    // works like the hashed cached_function's get_many (see above), but the parameters must be hashable too,
+    // so that the same arguments asked for twice are only computed once
+    template<typename Keys>
+    std::vector<detail::many_value_t<call_state_t>> get_many(const Keys &keys) {
+        return get_many_with(keys, [this](const auto &misses) { return detail::compute_each<call_state_t>(f, misses); });
+    }
+
+    template<typename Keys, typename FBatch>
+    std::vector<detail::many_value_t<call_state_t>> get_many(const Keys &keys, FBatch f_batch) {
+        return get_many_with(keys, [&](const auto &misses) { return detail::compute_batch<call_state_t>(f_batch, misses); });
+    }
+
+    template<typename Keys>
+    std::vector<detail::many_value_t<call_state_t>> get_many(const Keys &keys, fan_out parallel) {
+        return get_many_with(keys, [&](const auto &misses) { return detail::compute_fan_out<call_state_t>(f, misses, parallel.threads); });
+    }
+
+    // the older calls first, so that they're the ones dropped if a cache loading the snapshot is smaller
+    void save(const std::string &path) const {
+        detail::save_snapshot<call_state_t>(path, [this](auto &&write) {
+            for(const call_set *calls : {&old_calls, &new_calls})
+                for(const call_state_t &call : *calls)
+                    write(call, std::optional<std::chrono::steady_clock::duration>());
+        });
+    }
+
+    // returns the number of calls in the snapshot. calls which are already cached are kept.
+    std::size_t load(const std::string &path) {
+        return detail::load_snapshot<call_state_t>(path, [this](call_state_t call, auto time_left) {
+            if(!time_left || *time_left > std::chrono::steady_clock::duration::zero())
+                add(std::move(call));
+        });
     }
 
 private:
+    template<typename... Args>
+    const call_state_t &find_or_call(Args&&... args) {
+        std::tuple<Args&&...> arg_refs{std::forward<Args>(args)...};
+        // only hashed if the parameters can be, so that the generational cached_function doesn't need them to be
+        if constexpr(detail::params_hashable<stored_params_t>::value) {
+            if(hot)
+                hot->record(detail::hash_params<stored_params_t>(arg_refs), arg_refs);
+        }
+
+        if(const call_state_t *call = find(arg_refs)) {
+            counters.hits.add();
+            return *call;
+        }
+
+        counters.misses.add();
+        return add(counters.timed([&] { return detail::make_call<call_state_t>(f, std::forward<Args>(args)...); }));
+    }
+
+    template<typename Keys, typename Compute>
+    std::vector<detail::many_value_t<call_state_t>> get_many_with(const Keys &keys, Compute &&compute) {
+        return detail::get_many<call_state_t>(keys,
+            [this](std::uint64_t, const auto &key) -> std::optional<detail::many_value_t<call_state_t>> {
+                if(const call_state_t *call = find(key)) {
+                    counters.hits.add();
+                    return call->get_return_value();
+                }
+                counters.misses.add();
+                return {};
+            },
+            [&](const auto &misses) { return counters.timed([&] { return compute(misses); }); },
+            [this](std::uint64_t, call_state_t call) { add(std::move(call)); });
+    }
+
+    // a call found in the old calls is moved to the new ones, if that's where calls are being added
+    template<typename Key>
+    const call_state_t *find(const Key &key) {
+        auto it = new_calls.find(key);
+        if(it == new_calls.end()) {
+            it = old_calls.find(key);
+            if(it == old_calls.end())
+                return nullptr;
+
+            if(fill_new()) {
+                std::size_t bytes = measured(*it);
+                call_state_t call = std::move(old_calls.extract(it).value());
+                it = new_calls.insert(std::move(call)).first;
+                old_bytes -= bytes;
+                new_bytes += bytes;
+            }
+        }
+        return &kept(it);
+    }
+
+    // if the call is cached already (e.g. by f calling the cached_function recursively), that one is kept
+    const call_state_t &add(call_state_t &&call) {
+        bool into_new = fill_new();
+        std::size_t bytes = measured(call);
+        auto [it, added] = (into_new ? new_calls : old_calls).insert(std::move(call));
+        if(added)
+            (into_new ? new_bytes : old_bytes) += bytes;
+        return kept(it);
+    }
+
+    // std::set nodes aren't moved by the swap in expire, and it can't be in the old calls which are dropped
+    const call_state_t &kept(typename call_set::iterator it) {
+        if(new_calls.size() > max_size || new_bytes > max_bytes / 2)
+            expire();
+        return *it;
+    }
+
     bool fill_new() const {
-        return !new_calls.empty() || old_calls.size() >= max_size;
+        return !new_calls.empty() || old_calls.size() >= max_size || old_bytes >= max_bytes / 2;
+    }
+
+    std::size_t measured(const call_state_t &call) const { return measure ? measure(call) : 0; }
+
+    std::size_t measure_all(const call_set &calls) const {
+        std::size_t bytes = 0;
+        for(const call_state_t &call : calls)
+            bytes += measured(call);
+        return bytes;
     }
 
     std::size_t max_size = 25;
     Functor f;
     call_set new_calls;
     call_set old_calls;
+    detail::call_counters counters;
+    std::optional<detail::hot_key_tracker<stored_params_t>> hot;
+    std::function<std::size_t(const call_state_t&)> measure;  // empty until set_max_bytes is called
+    std::size_t max_bytes = SIZE_MAX;
+    std::size_t new_bytes = 0;
+    std::size_t old_bytes = 0;
 };
 
 #endif
@@ -0,0 +1,363 @@
+#ifndef LIPH_CONCURRENT_CACHED_FUNCTION_HPP
+#define LIPH_CONCURRENT_CACHED_FUNCTION_HPP
+
+#include "cached_function.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+
+/* A cached_function which can be called from several threads at once. The calls are split by the hash of
+ * their arguments into shards, each a cache_table (see cache_table.hpp) with its own mutex, so threads only
+ * wait for each other when they look up arguments in the same shard. Even a hit locks its shard exclusively,
+ * since it updates the shard's recency lists (or clock bits, and tinylfu's frequency sketch), so a
+ * std::shared_mutex wouldn't let hits run side by side; more shards spread out the contention instead. f is
+ * called without any lock held, so it must be safe to call from several threads at once, and it may call the
+ * concurrent_cached_function recursively (with different arguments).
+ *
+ * Misses are single-flight: while f is running for some arguments, other threads calling with the same
+ * arguments wait for its result rather than calling f again. If f throws, every waiting thread gets the
+ * exception, and nothing is cached, so the next call tries again.
+ *
+ * set_max_bytes, set_time_to_live and set_stale_while_revalidate work like they do for cached_function, except
+ * that the byte budget is split between the shards, so no call bigger than one shard's part of it is cached
+ * (see set_max_bytes). The refresh tasks may run on any thread. The expiry settings must be set before other
+ * threads start calling the concurrent_cached_function. stats(), hot_keys(), save, load and get_many work
+ * like they do for cached_function, too, but the misses of get_many aren't shared with other threads missing
+ * on the same arguments. There's no get_ref, since another thread could evict the call while it's being
+ * referred to; share_results(f) avoids copying big results instead.
+ *
+ *     concurrent_cached_function<std::string(*)(int)> lookup(100000, fetch_name);
+ *     // from any thread:
+ *     std::string name = lookup(id);
+ */
+template<typename Functor, typename Policy = cache_policy::clock>
+class concurrent_cached_function {
+    using call_state_t = decltype(detail::make_call_state(std::declval<Functor>()));
+    using stored_params_t = typename call_state_t::stored_params_t;
+    using return_t = typename call_state_t::return_t;
+
+    // the waiting threads share the one result in the future's shared state, so the call itself can be moved
+    // into the table
+    struct in_flight {
+        std::uint64_t hash;
+        stored_params_t params;
+        std::shared_future<return_t> result;
+        const std::promise<return_t> *owner;
+    };
+
+    struct alignas(64) shard {
+        explicit shard(std::size_t capacity) : calls(capacity) {}
+
+        template<typename Key>
+        typename std::vector<in_flight>::iterator find_in_flight(std::uint64_t hash, const Key &key) {
+            auto it = pending.begin();
+            while(it != pending.end() && !(it->hash == hash && it->params == key))
+                ++it;
+            return it;
+        }
+
+        // by then, the arguments may have been moved into f
+        void remove_in_flight(const std::promise<return_t> &owner) {
+            for(auto it = pending.begin(); it != pending.end(); ++it) {
+                if(it->owner == &owner) {
+                    pending.erase(it);
+                    return;
+                }
+            }
+        }
+
+        std::mutex mutex;
+        detail::cache_table<call_state_t, Policy> calls;
+        std::vector<in_flight> pending;   // usually only a few, so searched linearly
+        detail::call_counters counters;
+        std::optional<detail::hot_key_tracker<stored_params_t>> hot;
+    };
+
+public:
+    // max is split as evenly as possible between the shards. shard_count is rounded up to a power of 2, but
+    // is reduced for a small max, so that every shard has room for at least one call.
+    concurrent_cached_function(std::size_t max, Functor f, std::size_t shard_count = 16) : f(std::move(f)), shard_bits(0) {
+        while((std::size_t(1) << shard_bits) < shard_count)
+            ++shard_bits;
+        while(shard_bits > 0 && (std::size_t(1) << shard_bits) > max)
+            --shard_bits;
+
+        std::size_t count = std::size_t(1) << shard_bits;
+        shards = std::make_unique<std::unique_ptr<shard>[]>(count);
+        for(std::size_t i = 0; i < count; ++i)
+            shards[i] = std::make_unique<shard>(share_of(max, i));
+    }
+
+    template<typename... Args>
+    return_t operator()(Args&&... args) {
+        std::tuple<Args&&...> arg_refs{std::forward<Args>(args)...};
+        std::uint64_t hash = detail::hash_params<stored_params_t>(arg_refs);
+        shard &s = shard_of(hash);
+
+        // only made on a miss which no other thread is already computing, since making one allocates
+        std::optional<std::promise<return_t>> promise;
+        {
+            std::unique_lock<std::mutex> lock(s.mutex);
+            if(s.hot)
+                s.hot->record(hash, arg_refs);
+
+            bool refresh;
+            if(call_state_t *call = s.calls.find(hash, arg_refs, refresh)) {
+                s.counters.hits.add();
+                if(!refresh)
+                    return call->get_return_value();
+
+                return_t result = call->get_return_value();
+                stored_params_t params(call->params);
+                lock.unlock();
+                revalidate(s, hash, std::move(params));
+                return result;
+            }
+
+            // waiting on another thread's call to f is still a miss, but its time is only counted once
+            s.counters.misses.add();
+            auto it = s.find_in_flight(hash, arg_refs);
+            if(it != s.pending.end()) {
+                std::shared_future<return_t> result = it->result;
+                lock.unlock();
+                return result.get();
+            }
+
+            promise.emplace();
+            s.pending.push_back({hash, stored_params_t(arg_refs), promise->get_future().share(), &*promise});
+        }
+
+        // whatever throws (f, copying the result or adding the call), the waiting threads get the exception
+        auto start = std::chrono::steady_clock::now();
+        bool finished = false;
+        auto finish = [&] {   // with s.mutex held
+            s.counters.nanoseconds_in_f.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            s.remove_in_flight(*promise);
+            finished = true;
+        };
+
+        try {
+            call_state_t call = detail::make_call<call_state_t>(f, std::forward<Args>(args)...);
+            return_t result = call.get_return_value();
+            {
+                std::lock_guard<std::mutex> lock(s.mutex);
+                finish();
+                s.calls.insert(hash, std::move(call));
+            }
+            promise->set_value(result);
+            return result;
+        } catch(...) {
+            if(!finished) {
+                std::lock_guard<std::mutex> lock(s.mutex);
+                finish();
+            }
+            promise->set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+    // the number of shards stays as it is, so if max is less than that, some shards can't keep any calls
+    void set_max_size(std::size_t max) {
+        std::size_t count = shard_count();
+        for(std::size_t i = 0; i < count; ++i) {
+            std::lock_guard<std::mutex> lock(shards[i]->mutex);
+            shards[i]->calls.set_capacity(share_of(max, i));
+        }
+    }
+
+    // each shard gets its own part of bytes, which it can't go over even while other shards have room to
+    // spare. so a call which takes up more than bytes / shard count is never cached.
+    void set_max_bytes(std::size_t bytes) { set_max_bytes(bytes, detail::default_measure()); }
+
+    template<typename Measure>
+    void set_max_bytes(std::size_t bytes, Measure measure) {
+        std::size_t count = shard_count();
+        for(std::size_t i = 0; i < count; ++i) {
+            std::lock_guard<std::mutex> lock(shards[i]->mutex);
+            shards[i]->calls.set_max_bytes(share_of(bytes, i), detail::measure_calls<call_state_t>(measure));
+        }
+    }
+
+    void set_time_to_live(std::chrono::steady_clock::duration ttl, std::function<std::chrono::steady_clock::time_point()> now = std::chrono::steady_clock::now) {
+        expiry.ttl = ttl;
+        expiry.now = std::move(now);
+        apply_expiry();
+    }
+
+    void set_stale_while_revalidate(std::chrono::steady_clock::duration stale_for, std::function<void(std::function<void()>)> executor) {
+        expiry.stale_for = stale_for;
+        expiry.executor = std::move(executor);
+        apply_expiry();
+    }
+
+    void expire_all() {
+        for(std::size_t i = 0; i < shard_count(); ++i) {
+            std::lock_guard<std::mutex> lock(shards[i]->mutex);
+            shards[i]->calls.clear();
+        }
+    }
+
+    // calls may be added or evicted by other threads while the shards are being counted
+    std::size_t size() const {
+        std::size_t total = 0;
+        for(std::size_t i = 0; i < shard_count(); ++i) {
+            std::lock_guard<std::mutex> lock(shards[i]->mutex);
+            total += shards[i]->calls.size();
+        }
+        return total;
+    }
+
+    std::size_t current_bytes() const {
+        std::size_t total = 0;
+        for(std::size_t i = 0; i < shard_count(); ++i) {
+            std::lock_guard<std::mutex> lock(shards[i]->mutex);
+            total += shards[i]->calls.current_bytes();
+        }
+        return total;
+    }
+
+    // the counters are read without locking, so this doesn't slow down the callers
+    cache_stats stats() const {
+        cache_stats result;
+        for(std::size_t i = 0; i < shard_count(); ++i) {
+            shards[i]->counters.add_to(result);
+            shards[i]->calls.add_to(result);
+        }
+        return result;
+    }
+
+    // each shard keeps its own top k, which are merged by hot_keys()
+    void track_hot_keys(std::size_t k, std::size_t sample_every = 16) {
+        hot_count = k;
+        for(std::size_t i = 0; i < shard_count(); ++i) {
+            std::lock_guard<std::mutex> lock(shards[i]->mutex);
+            shards[i]->hot.emplace(k, sample_every);
+        }
+    }
+
+    std::vector<std::pair<stored_params_t, std::uint64_t>> hot_keys() const {
+        std::vector<std::pair<stored_params_t, std::uint64_t>> keys;
+        for(std::size_t i = 0; i < shard_count(); ++i) {
+            std::lock_guard<std::mutex> lock(shards[i]->mutex);
+            if(shards[i]->hot)
+                shards[i]->hot->report(keys);
+        }
+        detail::keep_hottest(keys, hot_count);
+        return keys;
+    }
+
+    template<typename Keys>
+    std::vector<detail::many_value_t<call_state_t>> get_many(const Keys &keys) {
+        return get_many_with(keys, [this](const auto &misses) { return detail::compute_each<call_state_t>(f, misses); });
+    }
+
+    template<typename Keys, typename FBatch>
+    std::vector<detail::many_value_t<call_state_t>> get_many(const Keys &keys, FBatch f_batch) {
+        return get_many_with(keys, [&](const auto &misses) { return detail::compute_batch<call_state_t>(f_batch, misses); });
+    }
+
+    template<typename Keys>
+    std::vector<detail::many_value_t<call_state_t>> get_many(const Keys &keys, fan_out parallel) {
+        return get_many_with(keys, [&](const auto &misses) { return detail::compute_fan_out<call_state_t>(f, misses, parallel.threads); });
+    }
+
+    // each shard is locked while its calls are copied out
+    void save(const std::string &path) const {
+        detail::save_snapshot<call_state_t>(path, [this](auto &&write) {
+            for(std::size_t i = 0; i < shard_count(); ++i) {
+                std::lock_guard<std::mutex> lock(shards[i]->mutex);
+                shards[i]->calls.for_each(write);
+            }
+        });
+    }
+
+    std::size_t load(const std::string &path) {
+        return detail::load_snapshot<call_state_t>(path, [this](call_state_t call, auto time_left) {
+            std::uint64_t hash = detail::hash_params<stored_params_t>(call.params);
+            shard &s = shard_of(hash);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if(!s.calls.contains(hash, call.params))
+                s.calls.insert(hash, std::move(call), time_left);
+        });
+    }
+
+private:
+    template<typename Keys, typename Compute>
+    std::vector<detail::many_value_t<call_state_t>> get_many_with(const Keys &keys, Compute &&compute) {
+        return detail::get_many<call_state_t>(keys,
+            [this](std::uint64_t hash, const auto &key) -> std::optional<detail::many_value_t<call_state_t>> {
+                shard &s = shard_of(hash);
+                std::lock_guard<std::mutex> lock(s.mutex);
+                if(call_state_t *call = s.calls.find(hash, key)) {
+                    s.counters.hits.add();
+                    return call->get_return_value();
+                }
+                s.counters.misses.add();
+                return {};
+            },
+            [&](const auto &misses) {
+                auto start = std::chrono::steady_clock::now();
+                auto calls = compute(misses);
+
+                // the time of the whole batch goes to the first shard
+                std::lock_guard<std::mutex> lock(shards[0]->mutex);
+                shards[0]->counters.nanoseconds_in_f.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+                return calls;
+            },
+            [this](std::uint64_t hash, call_state_t call) {
+                shard &s = shard_of(hash);
+                std::lock_guard<std::mutex> lock(s.mutex);
+                if(!s.calls.contains(hash, call.params))
+                    s.calls.insert(hash, std::move(call));
+            });
+    }
+
+    void apply_expiry() {
+        for(std::size_t i = 0; i < shard_count(); ++i) {
+            std::lock_guard<std::mutex> lock(shards[i]->mutex);
+            expiry.apply(shards[i]->calls);
+        }
+    }
+
+    void revalidate(shard &s, std::uint64_t hash, stored_params_t params) {
+        expiry.refresh([this, &s, hash, params = std::move(params)] {
+            try {
+                call_state_t call = detail::compute_call<call_state_t>(f, params);
+                std::lock_guard<std::mutex> lock(s.mutex);
+                s.calls.replace(hash, std::move(call));
+            } catch(...) {
+                std::lock_guard<std::mutex> lock(s.mutex);
+                s.calls.cancel_refresh(hash, params);
+            }
+        });
+    }
+
+    std::size_t shard_count() const { return std::size_t(1) << shard_bits; }
+
+    // shard i's part of total, where the parts add up to total
+    std::size_t share_of(std::size_t total, std::size_t i) const {
+        return total / shard_count() + (i < total % shard_count() ? 1 : 0);
+    }
+
+    // cache_table uses the low bits of the hash, so the shard is picked with the high bits
+    shard &shard_of(std::uint64_t hash) { return *shards[shard_bits ? hash >> (64 - shard_bits) : 0]; }
+
+    Functor f;
+    std::size_t shard_bits;
+    std::unique_ptr<std::unique_ptr<shard>[]> shards;
+    detail::expiry_settings expiry;
+    std::size_t hot_count = 0;
+};
+
+#endif
@@ -40,5 +40,8 @@ int main() {
     i = 0;
     std::cout << bar(i) << std::endl;
     std::cout << baz(&i) << std::endl;
+
+    cache_stats stats = foo.stats();
+    std::cout << "foo: " << stats.hits << " hits, " << stats.misses << " misses" << std::endl;
     return 0;
 }
@@ -1,7 +1,15 @@
 #include "cached_function.hpp"
 
+#include <chrono>
+#include <cstdio>
 #include <cstdint>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
 
 
 std::uint64_t do_fib(std::uint64_t);
@@ -18,6 +26,18 @@ std::uint64_t do_fib(std::uint64_t x) {
 }
 
 
+std::uint64_t do_hashed_fib(std::uint64_t);
+
+cached_function<std::uint64_t(*)(std::uint64_t), cache_policy::clock> hashed_fib(40, do_hashed_fib);
+
+std::uint64_t do_hashed_fib(std::uint64_t x) {
+    if(x <= 1)
+        return 1;
+    else
+        return hashed_fib(x - 1) + hashed_fib(x - 2);
+}
+
+
 std::uint64_t fib_no_cache(std::uint64_t x) {
     if(x <= 1)
         return 1;
@@ -26,8 +46,203 @@ std::uint64_t fib_no_cache(std::uint64_t x) {
 }
 
 
+// cached by memory, not by the number of calls
+cached_function<std::vector<int>(*)(int), cache_policy::slru> divisors(1000000, [](int x) {
+    std::vector<int> result;
+    for(int d = 1; d <= x; ++d)
+        if(x % d == 0)
+            result.push_back(d);
+    return result;
+});
+
+
+// a clock which only moves when it's told to, and an executor which runs refreshes when it's told to
+std::chrono::steady_clock::time_point fake_now;
+std::vector<std::function<void()>> refreshes;
+int rate_version = 1;
+
+cached_function<int(*)(int), cache_policy::clock> exchange_rate(100, [](int currency) {
+    return currency * 100 + rate_version;
+});
+
+
+// looked up by std::string_views without making std::strings, and returning the big results without copying them
+cached_function<std::vector<int>(*)(const std::string&), cache_policy::clock> char_codes(100, [](const std::string &s) {
+    return std::vector<int>(s.begin(), s.end());
+});
+
+cached_function<shared_results_t<std::vector<int>(*)(int)>, cache_policy::clock> shared_divisors(100, share_results(+[](int x) {
+    return divisors(x);
+}));
+
+
+// the hit rate of a cache of 20 calls, when 10 hot keys are looked up in between scans of keys looked up twice
+template<typename Policy>
+double scan_hit_rate() {
+    cached_function<int(*)(int), Policy> cached(20, [](int x) { return x * 2; });
+    int next = 1000;
+    for(int round = 0; round < 100; ++round) {
+        for(int x = 0; x < 10; ++x)
+            cached(x);
+        for(int i = 0; i < 30; ++i, ++next) {
+            cached(next);
+            cached(next);
+        }
+    }
+    return cached.stats().hit_rate();
+}
+
+
 int main() {
     fib.set_max_size(40);
     std::cout << fib(40) << std::endl;
+    auto fibs = fib.get_many(std::vector<std::tuple<std::uint64_t>>{{10}, {50}, {10}});
+    std::cout << fibs[0] << ' ' << fibs[1] << ' ' << fibs[2] << std::endl;
+    std::cout << hashed_fib(90) << ' ' << hashed_fib.size() << std::endl;
     std::cout << fib_no_cache(40) << std::endl;
+
+    divisors.set_max_bytes(4096);
+    for(int x = 1; x <= 1000; ++x)
+        divisors(x);
+    std::cout << divisors(720).size() << ' ' << (divisors.current_bytes() <= 4096) << ' ' << divisors.size() << std::endl;
+    auto divisor_lists = divisors.get_many(std::vector<std::tuple<int>>{{12}, {2000}, {2001}, {12}}, fan_out{2});
+    std::cout << divisor_lists[0].size() << ' ' << divisor_lists[1].size() << ' ' << divisor_lists[2].size() << std::endl;
+
+    // the generational cached_function drops a generation once the newer one has half of the budget
+    cached_function recent_divisors(1000000, [](int x) { return divisors(x); });
+    recent_divisors(720);
+    recent_divisors.set_max_bytes(4096);
+    std::size_t one_call = recent_divisors.current_bytes();
+    for(int x = 1; x <= 1000; ++x)
+        recent_divisors(x);
+    std::cout << (one_call > 0) << ' ' << (recent_divisors.current_bytes() <= 4096) << ' ' << (recent_divisors.stats().evictions > 0) << std::endl;
+
+    exchange_rate.set_time_to_live(std::chrono::seconds(60), [] { return fake_now; });
+    exchange_rate.set_stale_while_revalidate(std::chrono::seconds(30), [](std::function<void()> task) {
+        refreshes.push_back(std::move(task));
+    });
+
+    std::cout << exchange_rate(3);
+    rate_version = 2;
+    fake_now += std::chrono::seconds(70);
+    std::cout << ' ' << exchange_rate(3) << ' ' << exchange_rate(3) << ' ' << refreshes.size();  // stale, and refreshed once
+    for(auto &refresh : refreshes)
+        refresh();
+    std::cout << ' ' << exchange_rate(3);
+    rate_version = 3;
+    fake_now += std::chrono::seconds(200);
+    std::cout << ' ' << exchange_rate(3) << std::endl;  // too stale, so it's recomputed right away
+
+    // a refresh which only runs once its cached_function has gone does nothing
+    std::vector<std::function<void()>> late_refreshes;
+    {
+        cached_function<int(*)(int), cache_policy::clock> short_lived(10, [](int x) { return x; });
+        short_lived.set_time_to_live(std::chrono::seconds(60), [] { return fake_now; });
+        short_lived.set_stale_while_revalidate(std::chrono::seconds(30), [&](std::function<void()> task) {
+            late_refreshes.push_back(std::move(task));
+        });
+        short_lived(1);
+        fake_now += std::chrono::seconds(70);
+        short_lived(1);
+    }
+    for(auto &refresh : late_refreshes)
+        refresh();
+    std::cout << late_refreshes.size() << std::endl;
+
+    // the time to live only applies to calls cached after it's set
+    cached_function<int(*)(int), cache_policy::clock> later_ttl(10, [](int x) { return x; });
+    later_ttl(1);
+    later_ttl(2);
+    later_ttl.set_time_to_live(std::chrono::hours(1), [] { return fake_now; });
+    later_ttl(3);
+    fake_now += std::chrono::hours(2);
+    for(int x = 1; x <= 3; ++x)
+        later_ttl(x);
+    std::cout << later_ttl.stats().misses << ' ' << later_ttl.stats().expiries << std::endl;
+
+    cache_stats stats = exchange_rate.stats();
+    std::cout << stats.hits << ' ' << stats.misses << ' ' << stats.expiries << std::endl;
+
+    // the small numbers are looked up most
+    hashed_fib.track_hot_keys(3, 1);
+    for(std::uint64_t x = 1; x <= 20; ++x)
+        for(std::uint64_t y = 0; y < 100 / x; ++y)
+            hashed_fib(x);
+    for(auto &[params, count] : hashed_fib.hot_keys())
+        std::cout << std::get<0>(params) << ':' << count << ' ';
+    std::cout << hashed_fib.stats().hit_rate() << std::endl;
+
+    // and the same for the generational cached_function
+    fib.track_hot_keys(2, 1);
+    for(std::uint64_t x = 1; x <= 20; ++x)
+        for(std::uint64_t y = 0; y < 100 / x; ++y)
+            fib(x);
+    for(auto &[params, count] : fib.hot_keys())
+        std::cout << std::get<0>(params) << ':' << count << ' ';
+    std::cout << std::endl;
+
+    // a restarted process could load the calls instead of starting over
+    hashed_fib.save("fib.cache");
+    cached_function<std::uint64_t(*)(std::uint64_t), cache_policy::clock> restarted(100, fib_no_cache);
+    std::cout << restarted.load("fib.cache") << ' ' << restarted(80) << std::endl;
+    std::remove("fib.cache");
+
+    // and the same for the generational cached_function
+    fib.save("fib.cache");
+    cached_function restarted_fib(100, fib_no_cache);
+    std::size_t loaded = restarted_fib.load("fib.cache");
+    std::cout << (loaded > 0) << ' ' << restarted_fib(20) << ' ' << restarted_fib.stats().hits << std::endl;
+    std::remove("fib.cache");
+
+    // a loaded call expires when it would have in the cache it was saved from
+    auto rate = [](int currency) { return currency * 100 + rate_version; };
+    cached_function<int(*)(int), cache_policy::clock> rates(100, rate), reloaded_rates(100, rate), late_rates(100, rate);
+    for(auto *cache : {&rates, &reloaded_rates, &late_rates})
+        cache->set_time_to_live(std::chrono::seconds(60), [] { return fake_now; });
+    rates(5);
+    fake_now += std::chrono::seconds(40);
+    rates(6);
+    rates.save("rates.cache");
+    reloaded_rates.load("rates.cache");
+    fake_now += std::chrono::seconds(30);
+    reloaded_rates(5);  // expired 10 seconds ago
+    reloaded_rates(6);
+    std::cout << reloaded_rates.stats().hits << ' ' << reloaded_rates.stats().misses;
+
+    // and calls which have expired by the time they're saved aren't loaded at all
+    fake_now += std::chrono::seconds(60);
+    rates.save("rates.cache");
+    std::cout << ' ' << late_rates.load("rates.cache") << ' ' << late_rates.size() << std::endl;
+    std::remove("rates.cache");
+
+    // tinylfu keeps the hot keys through the scans
+    std::cout << scan_hit_rate<cache_policy::slru>() << ' ' << scan_hit_rate<cache_policy::tinylfu>() << std::endl;
+
+    // shrinking keeps the calls which were made more than once, since they're still in the protected list
+    cached_function<int(*)(int), cache_policy::slru> shrunk(10, [](int x) { return x * 2; });
+    for(int x = 0; x < 10; ++x)
+        shrunk(x);
+    for(int x = 0; x < 5; ++x)
+        shrunk(x);
+    shrunk.set_max_size(6);
+    shrunk(100);
+    shrunk(101);
+    std::uint64_t hits_before = shrunk.stats().hits;
+    for(int x = 1; x < 5; ++x)
+        shrunk(x);
+    std::cout << shrunk.stats().hits - hits_before << ' ' << shrunk.size() << std::endl;
+
+    std::string_view words = "cached function";
+    const std::vector<int> &codes = char_codes.get_ref(words.substr(0, 6));   // only valid until char_codes is next used
+    std::cout << codes.size() << ' ' << codes[0];
+    std::cout << ' ' << char_codes.get_ref(std::string("cached"))[5] << ' ' << char_codes.stats().hits;
+    std::shared_ptr<const std::vector<int>> d1 = shared_divisors(360), d2 = shared_divisors(360);
+    std::cout << ' ' << d1->size() << ' ' << (d1 == d2) << std::endl;
+
+    // f can take its parameters as rvalue references, and move from them, without moving from the cached key
+    auto take_length = [](std::string &&s) { std::string taken = std::move(s); return taken.size(); };
+    cached_function lengths = take_length;
+    cached_function<decltype(take_length), cache_policy::clock> hashed_lengths(10, take_length);
+    std::cout << lengths(std::string("abc")) << ' ' << lengths(std::string("abc")) << ' ' << lengths.stats().hits;
+    std::cout << ' ' << hashed_lengths("abcd") << ' ' << hashed_lengths(std::string("abcd")) << ' ' << hashed_lengths.stats().hits << std::endl;
 }
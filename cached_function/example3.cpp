@@ -0,0 +1,134 @@
+#include "concurrent_cached_function.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+
+std::atomic<int> square_calls{0};
+
+concurrent_cached_function slow_square(1000, [](std::uint64_t x) {
+    ++square_calls;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return x * x;
+});
+
+std::atomic<int> report_calls{0};
+
+// every thread asks for the same report at once, but it's only built once
+concurrent_cached_function build_report(10, [](int id) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    if(report_calls++ == 0)
+        throw std::runtime_error("database unavailable");
+    return id * 10;
+});
+
+// a result which can't be copied while copies_fail is set
+std::atomic<bool> copies_fail{false};
+
+struct fragile {
+    explicit fragile(int x) : x(x) {}
+    fragile(const fragile &other) : x(other.x) {
+        if(copies_fail)
+            throw std::runtime_error("copy failed");
+    }
+    fragile(fragile &&) = default;
+
+    int x;
+};
+
+concurrent_cached_function build_fragile(10, [](int x) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    return fragile(x);
+});
+
+
+template<typename F>
+void run_threads(int count, F f) {
+    std::vector<std::thread> threads;
+    for(int t = 0; t < count; ++t)
+        threads.emplace_back(f);
+    for(std::thread &t : threads)
+        t.join();
+}
+
+
+int main() {
+    std::atomic<std::uint64_t> sum{0};
+    run_threads(8, [&] {
+        for(int round = 0; round < 10; ++round)
+            for(std::uint64_t x = 0; x < 100; ++x)
+                sum += slow_square(x);
+    });
+
+    // concurrent misses on the same square wait for the first one, so each is computed once
+    cache_stats stats = slow_square.stats();
+    std::cout << sum << ' ' << slow_square.size() << ' ' << square_calls << ' ' << stats.hits + stats.misses << std::endl;
+
+    // the first attempt fails for every thread which was waiting on it, and isn't cached
+    std::atomic<int> failures{0};
+    run_threads(8, [&] {
+        try {
+            build_report(4);
+        } catch(const std::runtime_error &) {
+            ++failures;
+        }
+    });
+    std::cout << failures << ' ' << build_report(4) << ' ' << build_report(4) << ' ' << report_calls << std::endl;
+
+    // the waiting threads get the exception from copying the result, too, rather than a broken promise
+    copies_fail = true;
+    std::atomic<int> copy_failures{0};
+    run_threads(8, [&] {
+        try {
+            build_fragile(1);
+        } catch(const std::runtime_error &) {
+            ++copy_failures;
+        }
+    });
+    copies_fail = false;
+    std::cout << copy_failures << ' ' << build_fragile(1).x << std::endl;
+
+    // the squares which aren't cached yet are computed in one batch, as if by one round trip to a server
+    int batches = 0;
+    auto squares = slow_square.get_many(std::vector<std::tuple<std::uint64_t>>{{5}, {500}, {501}, {500}}, [&](const auto &misses) {
+        ++batches;
+        std::vector<std::uint64_t> results;
+        for(auto &[x] : misses)
+            results.push_back(x * x);
+        return results;
+    });
+    std::cout << squares[0] << ' ' << squares[1] << ' ' << squares[3] << ' ' << batches << ' ' << slow_square.size() << std::endl;
+
+    // room for fewer calls than the default 16 shards, so fewer shards are used, and the size stays within 5
+    concurrent_cached_function few_squares(5, [](std::uint64_t x) { return x * x; });
+    for(std::uint64_t x = 0; x < 100; ++x)
+        few_squares(x);
+    std::cout << few_squares.size() << std::endl;
+
+    // the refresh is still running on another thread when the cache is destroyed, which waits for it
+    std::vector<std::future<void>> refreshing;
+    {
+        concurrent_cached_function slow_double(10, [](int x) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            return x * 2;
+        });
+        slow_double.set_time_to_live(std::chrono::milliseconds(1));
+        slow_double.set_stale_while_revalidate(std::chrono::hours(1), [&](std::function<void()> task) {
+            refreshing.push_back(std::async(std::launch::async, std::move(task)));
+        });
+        slow_double(21);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        std::cout << slow_double(21);
+    }
+    for(std::future<void> &refresh : refreshing)
+        refresh.get();
+    std::cout << ' ' << refreshing.size() << std::endl;
+}
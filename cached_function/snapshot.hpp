@@ -0,0 +1,257 @@
+#ifndef LIPH_CACHED_FUNCTION_SNAPSHOT_HPP
+#define LIPH_CACHED_FUNCTION_SNAPSHOT_HPP
+
+#include "cache_stats.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/* A snapshot of a cached_function is a header followed by each call's parameters and then its return value.
+ * Trivially copyable types are written as their raw bytes, and std::strings as their length followed by
+ * their characters. Other types need a specialization of cache_serializer:
+ *
+ *     template<>
+ *     struct cache_serializer<point> {
+ *         static void write(std::string &out, const point &p) { cache_serializer<double>::write(out, p.x); ... }
+ *         static std::optional<point> read(const char *&data, const char *end) { ... }
+ *     };
+ *
+ * where read advances data past what it read, and returns an empty optional if the data runs out first.
+ * Pointers aren't saved by default, since what they point to isn't.
+ *
+ * With a time to live, each call's expiry is saved as a std::chrono::system_clock time, so a loaded call
+ * expires when it would have if the process had kept running, and calls which have become too stale by
+ * then aren't loaded.
+ *
+ * The header holds a hash of the names of the parameter and return types, so a snapshot can't be loaded
+ * into a cached_function of different types (by a build from the same compiler), and a checksum, so a
+ * snapshot which was cut short or changed is rejected before anything from it is cached.
+ */
+
+template<typename T, typename = void>
+struct cache_serializer {
+    static_assert(std::is_trivially_copyable_v<T>, "specialize cache_serializer to save types which aren't trivially copyable");
+    static_assert(!std::is_pointer_v<T> && !std::is_member_pointer_v<T>, "pointers can't be saved, since what they point to isn't");
+
+    static void write(std::string &out, const T &value) { out.append(reinterpret_cast<const char*>(&value), sizeof(T)); }
+
+    static std::optional<T> read(const char *&data, const char *end) {
+        if(static_cast<std::size_t>(end - data) < sizeof(T))
+            return {};
+
+        // the data isn't necessarily aligned for T
+        alignas(T) unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, data, sizeof(T));
+        data += sizeof(T);
+        return *std::launder(reinterpret_cast<T*>(bytes));
+    }
+};
+
+template<>
+struct cache_serializer<std::string> {
+    static void write(std::string &out, const std::string &value) {
+        cache_serializer<std::uint64_t>::write(out, value.size());
+        out += value;
+    }
+
+    static std::optional<std::string> read(const char *&data, const char *end) {
+        std::optional<std::uint64_t> size = cache_serializer<std::uint64_t>::read(data, end);
+        if(!size || *size > static_cast<std::uint64_t>(end - data))
+            return {};
+
+        std::string value(data, *size);
+        data += *size;
+        return value;
+    }
+};
+
+
+namespace detail {
+
+
+struct snapshot_header {
+    char magic[8];
+    std::uint64_t types;
+    std::uint64_t count;
+    std::uint64_t payload_size;
+    std::uint64_t checksum;
+};
+
+inline constexpr char snapshot_magic[8] = {'L', 'I', 'P', 'H', 'C', 'F', '0', '2'};
+
+// saved in place of the expiry of a call which doesn't expire
+inline constexpr std::int64_t snapshot_never_expires = INT64_MAX;
+
+
+// 8 bytes at a time, so checking a snapshot costs little next to reading it
+inline std::uint64_t snapshot_checksum(const char *data, std::size_t size) {
+    std::uint64_t hash = size;
+    std::size_t i = 0;
+    for(; i + 8 <= size; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = mix_hash(hash ^ word);
+    }
+
+    std::uint64_t tail = 0;
+    std::memcpy(&tail, data + i, size - i);
+    return mix_hash(hash ^ tail);
+}
+
+template<typename Params, typename R>
+std::uint64_t snapshot_types() {
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for(const char *name : {typeid(Params).name(), "->", typeid(R).name()})
+        for(; *name; ++name)
+            hash = (hash ^ static_cast<unsigned char>(*name)) * 0x100000001b3ULL;
+    return hash;
+}
+
+
+// for_each(write) calls write(call, time_left) for each call_state to save, where time_left is an optional
+// duration until the call expires
+template<typename CallState, typename ForEach>
+void save_snapshot(const std::string &path, ForEach &&for_each) {
+    using return_t = typename CallState::return_t;
+    using params_t = typename CallState::stored_params_t;
+    static_assert(!std::is_reference_v<return_t>, "cached_functions which return references can't be saved");
+
+    std::string payload;
+    std::uint64_t count = 0;
+    auto saved_at = std::chrono::system_clock::now();
+    for_each([&](const CallState &call, const auto &time_left) {
+        std::apply([&](const auto&... param) {
+            (cache_serializer<std::decay_t<decltype(param)>>::write(payload, param), ...);
+        }, call.params);
+        cache_serializer<return_t>::write(payload, call.return_value_ref());
+
+        std::int64_t expires = snapshot_never_expires;
+        if(time_left)
+            expires = std::chrono::duration_cast<std::chrono::nanoseconds>((saved_at + *time_left).time_since_epoch()).count();
+        cache_serializer<std::int64_t>::write(payload, expires);
+        ++count;
+    });
+
+    snapshot_header header{{}, snapshot_types<params_t, return_t>(), count, payload.size(), snapshot_checksum(payload.data(), payload.size())};
+    std::memcpy(header.magic, snapshot_magic, sizeof header.magic);
+
+    // written next to the old snapshot and then renamed over it, so a crash never leaves half a snapshot
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof header);
+        out.write(payload.data(), payload.size());
+        if(!out)
+            throw std::runtime_error("unable to write cached_function snapshot " + path);
+    }
+    if(std::rename(temp_path.c_str(), path.c_str()) != 0)
+        throw std::runtime_error("unable to write cached_function snapshot " + path);
+}
+
+
+template<typename CallState>
+struct snapshot_call {
+    CallState call;
+    std::int64_t expires;
+};
+
+template<typename CallState, std::size_t... Is>
+std::optional<snapshot_call<CallState>> read_call(const char *&data, const char *end, std::index_sequence<Is...>) {
+    using params_t = typename CallState::stored_params_t;
+    using return_t = typename CallState::return_t;
+
+    // braced initialization reads the parameters in order
+    std::tuple<std::optional<std::tuple_element_t<Is, params_t>>...> params{cache_serializer<std::tuple_element_t<Is, params_t>>::read(data, end)...};
+    if(!(std::get<Is>(params) && ...))
+        return {};
+
+    std::optional<return_t> value = cache_serializer<return_t>::read(data, end);
+    if(!value)
+        return {};
+    std::optional<std::int64_t> expires = cache_serializer<std::int64_t>::read(data, end);
+    if(!expires)
+        return {};
+    return snapshot_call<CallState>{CallState(std::move(*value), std::move(*std::get<Is>(params))...), *expires};
+}
+
+
+// calls add(call_state, time_left) for each call in the snapshot, where time_left is an optional
+// std::chrono::steady_clock::duration until the call expires, and returns how many calls there were. the
+// whole snapshot is read and checked before anything is added.
+template<typename CallState, typename Add>
+std::size_t load_snapshot(const std::string &path, Add &&add) {
+    using params_t = typename CallState::stored_params_t;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("unable to open cached_function snapshot " + path);
+
+    struct stat st;
+    void *mapped = MAP_FAILED;
+    if(::fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(snapshot_header))
+        mapped = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if(mapped == MAP_FAILED)
+        throw std::runtime_error("unable to map cached_function snapshot " + path);
+
+    std::size_t length = st.st_size;
+    std::unique_ptr<void, std::function<void(void*)>> mapping(mapped, [length](void *p) { ::munmap(p, length); });
+    ::madvise(mapped, length, MADV_SEQUENTIAL);
+
+    const char *data = static_cast<const char*>(mapped) + sizeof(snapshot_header);
+    snapshot_header header;
+    std::memcpy(&header, mapped, sizeof header);
+    if(std::memcmp(header.magic, snapshot_magic, sizeof header.magic) != 0
+            || header.types != snapshot_types<params_t, typename CallState::return_t>()
+            || header.payload_size != length - sizeof header
+            || header.checksum != snapshot_checksum(data, header.payload_size))
+        throw std::runtime_error("invalid cached_function snapshot " + path);
+
+    const char *end = data + header.payload_size;
+    std::vector<snapshot_call<CallState>> calls;
+    while(data != end) {
+        std::optional<snapshot_call<CallState>> call = read_call<CallState>(data, end, std::make_index_sequence<std::tuple_size_v<params_t>>());
+        if(!call)
+            throw std::runtime_error("invalid cached_function snapshot " + path);
+        calls.push_back(std::move(*call));
+    }
+    if(calls.size() != header.count)
+        throw std::runtime_error("invalid cached_function snapshot " + path);
+
+    auto now = std::chrono::system_clock::now();
+    for(snapshot_call<CallState> &loaded : calls) {
+        std::optional<std::chrono::steady_clock::duration> time_left;
+        if(loaded.expires != snapshot_never_expires) {
+            std::chrono::system_clock::time_point expires{std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(loaded.expires))};
+            time_left = std::chrono::duration_cast<std::chrono::steady_clock::duration>(expires - now);
+        }
+        add(std::move(loaded.call), time_left);
+    }
+    return calls.size();
+}
+
+
+} // namespace detail
+
+#endif
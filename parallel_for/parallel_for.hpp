@@ -0,0 +1,63 @@
+#ifndef LIPH_PARALLEL_FOR_HPP
+#define LIPH_PARALLEL_FOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+
+/* run_workers(thread_count, worker) calls worker(thread_index, failed) on thread_count threads, the calling
+ * thread being thread 0. failed is a const std::atomic<bool> & which becomes true once any worker has thrown,
+ * so that the others can stop early. Once they've all stopped, the first exception thrown is rethrown.
+ *
+ * parallel_for(count, func) calls func(index) for each index in [0, count), on up to thread_count threads,
+ * each taking the next index as it becomes free. No more indexes are started after an exception.
+ *
+ * The threads are started for each call, rather than kept in a pool, so each call costs a few thread
+ * creations, which is only worth it when the work is much bigger than that.
+ */
+
+
+template<typename Worker>
+void run_workers(std::size_t thread_count, Worker worker) {
+    std::atomic<bool> failed = false;
+    std::exception_ptr first_error;   // only written by the thread which set failed
+
+    auto run = [&](std::size_t thread_index) {
+        try {
+            worker(thread_index, static_cast<const std::atomic<bool>&>(failed));
+        } catch(...) {
+            if(!failed.exchange(true))
+                first_error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for(std::size_t i = 1; i < thread_count; ++i)
+        threads.emplace_back(run, i);
+    run(0);
+
+    for(std::thread &thread : threads)
+        thread.join();
+
+    if(first_error)
+        std::rethrow_exception(first_error);
+}
+
+
+template<typename Func>
+void parallel_for(std::size_t count, Func func, std::size_t thread_count = std::thread::hardware_concurrency()) {
+    thread_count = std::clamp<std::size_t>(thread_count, 1, std::max<std::size_t>(count, 1));
+    std::atomic<std::size_t> next_index = 0;
+
+    run_workers(thread_count, [&](std::size_t, const std::atomic<bool> &failed) {
+        for(std::size_t i = next_index++; i < count && !failed; i = next_index++)
+            func(i);
+    });
+}
+
+
+#endif
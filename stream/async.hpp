@@ -0,0 +1,219 @@
+#ifndef LIPH_STREAM_ASYNC_HPP
+#define LIPH_STREAM_ASYNC_HPP
+
+#include "core.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+
+/* buffered(n) runs everything before it in the stream on a thread of its own, which hands the values over
+ * in blocks (see next_batch) through a ring buffer holding up to n blocks. Once the buffer is full, the
+ * upstream thread waits for the rest of the stream to catch up. This lets expensive stages which have to
+ * see the values in order run at the same time as each other:
+ *
+ *     auto records = mapped_lines("data.csv")
+ *         | mapping(parse) | async_stage
+ *         | mapping(enrich) | async_stage
+ *         | as_vector;
+ *
+ * The thread is started by the first call to next(), and is stopped when the stream is destroyed. An
+ * exception thrown upstream is rethrown by next() once the values before it have been consumed. The thread
+ * refers to the stages before it where they are, so a stream must not be copied or moved once it has
+ * started (before then, it can be).
+ *
+ * Either side waits (with std::atomic::wait) when the buffer is empty or full, rather than spinning.
+ */
+
+namespace stream {
+
+
+namespace detail {
+
+
+// lock-free queue for exactly one producer thread and one consumer thread. values are swapped in and out
+// of the slots, so when T is a vector, its memory is passed back and forth instead of reallocated.
+template<typename T>
+class spsc_ring {
+public:
+    explicit spsc_ring(std::size_t capacity) : slots(round_up(capacity)), mask(slots.size() - 1), head(0), tail(0) {}
+
+    bool try_push(T &value) {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if(t - head.load(std::memory_order_acquire) == slots.size())
+            return false;
+
+        std::swap(slots[t & mask], value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T &value) {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if(h == tail.load(std::memory_order_acquire))
+            return false;
+
+        std::swap(slots[h & mask], value);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static std::size_t round_up(std::size_t capacity) {
+        std::size_t size = 1;
+        while(size < capacity)
+            size *= 2;
+        return size;
+    }
+
+    std::vector<T> slots;
+    std::size_t mask;
+    alignas(64) std::atomic<std::size_t> head;  // only written by the consumer
+    alignas(64) std::atomic<std::size_t> tail;  // only written by the producer
+};
+
+
+template<typename T>
+class async_buffer {
+    struct state {
+        explicit state(std::size_t capacity) : ring(capacity), stopping(false), finished(false) {}
+
+        ~state() {
+            stopping = true;
+            signal(pops);
+            if(worker.joinable())
+                worker.join();
+        }
+
+        // wakes the other side if it's waiting on counter
+        static void signal(std::atomic<std::uint32_t> &counter) {
+            counter.fetch_add(1, std::memory_order_release);
+            counter.notify_one();
+        }
+
+        spsc_ring<std::vector<T>> ring;
+        std::thread worker;
+        std::exception_ptr error;
+        std::atomic<bool> stopping;
+        std::atomic<bool> finished;
+        // bumped after each push (and when finishing) and each pop (and when stopping). a side which finds
+        // the ring empty or full waits for the other's counter to change from what it was before looking.
+        std::atomic<std::uint32_t> pushes{0};
+        std::atomic<std::uint32_t> pops{0};
+    };
+
+public:
+    explicit async_buffer(std::size_t capacity) : capacity(capacity), s(std::make_unique<state>(capacity)), index(0) {}
+
+    // the copy gets a buffer of its own, which hasn't been started. neither copying nor moving is safe
+    // once the buffer has started (see above).
+    async_buffer(const async_buffer &other) : async_buffer(other.capacity) {}
+    async_buffer(async_buffer &&) = default;
+
+    template<typename Op>
+    std::optional<T> next(Op &prev_op) {
+        if(index == current.size()) {
+            if(!next_batch(prev_op, current))
+                return {};
+            index = 0;
+        }
+        return std::move(current[index++]);
+    }
+
+    template<typename Op>
+    bool next_batch(Op &prev_op, std::vector<T> &out) {
+        if(index < current.size()) {
+            out.assign(std::make_move_iterator(current.begin() + index), std::make_move_iterator(current.end()));
+            index = current.size();
+            return true;
+        }
+
+        if(!s->worker.joinable())
+            start(prev_op);
+
+        out.clear();
+        for(;;) {
+            std::uint32_t seen = s->pushes.load(std::memory_order_acquire);
+            if(s->ring.try_pop(out))
+                break;
+
+            if(s->finished.load(std::memory_order_acquire)) {
+                // the last block may have been pushed just before finishing
+                if(s->ring.try_pop(out))
+                    break;
+                if(s->error)
+                    std::rethrow_exception(std::exchange(s->error, nullptr));
+                return false;
+            }
+            s->pushes.wait(seen, std::memory_order_acquire);
+        }
+
+        state::signal(s->pops);
+        return true;
+    }
+
+private:
+    template<typename Op>
+    void start(Op &prev_op) {
+        state *st = s.get();
+        st->worker = std::thread([st, &prev_op] {
+            std::vector<T> block;
+            try {
+                while(!st->stopping && detail::next_batch(prev_op, block)) {
+                    for(;;) {
+                        std::uint32_t seen = st->pops.load(std::memory_order_acquire);
+                        if(st->ring.try_push(block))
+                            break;
+                        if(st->stopping)
+                            return;
+                        st->pops.wait(seen, std::memory_order_acquire);
+                    }
+                    state::signal(st->pushes);
+                }
+            } catch(...) {
+                st->error = std::current_exception();
+            }
+            st->finished.store(true, std::memory_order_release);
+            state::signal(st->pushes);
+        });
+    }
+
+    std::size_t capacity;
+    std::unique_ptr<state> s;
+    std::vector<T> current;
+    std::size_t index;
+};
+
+
+struct buffered_op {
+    template<typename Op, typename T>
+    std::optional<T> operator()(Op &prev_op, async_buffer<T> &buffer) const { return buffer.next(prev_op); }
+
+    template<typename Op, typename Scratch, typename T>
+    bool batch(Op &prev_op, Scratch &, std::vector<T> &out, async_buffer<T> &buffer) const { return buffer.next_batch(prev_op, out); }
+};
+struct buffered_init {
+    template<typename Src>
+    auto operator()(Src &, std::size_t capacity) const {
+        return std::make_tuple(async_buffer<typename Src::value_type>(capacity));
+    }
+};
+
+
+} // namespace detail
+
+
+constexpr inline stream_op buffered{detail::buffered_op{}, detail::buffered_init{}};
+constexpr inline auto async_stage = buffered(4);
+
+
+} // namespace stream
+
+#endif
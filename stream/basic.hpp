@@ -2,7 +2,13 @@
 #define LIPH_STREAM_BASIC_HPP
 
 #include "core.hpp"
+#include "../push_back_unchecked/push_back_unchecked.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <stdexcept>
+#include <type_traits>
 #include <vector>
 
 
@@ -17,6 +23,15 @@ public:
 };
 
 
+// upto(start, unbounded) never ends
+struct unbounded_t {
+    // a hidden friend, so it's only found for comparisons with unbounded itself
+    template<typename T>
+    friend constexpr bool operator<(const T &, unbounded_t) { return true; }
+};
+constexpr inline unbounded_t unbounded;
+
+
 namespace detail {
 
 
@@ -48,6 +63,7 @@ struct upto_gen {
                 T ret = start;
                 start += step;
                 return ret;
+            }
         } else {
             if(start != end) {
                 T ret = start;
@@ -58,11 +74,45 @@ struct upto_gen {
 
         return {};
     }
+
+    template<typename T, typename U>
+    constexpr bool batch(std::vector<T> &out, T &start, U &end) const {
+        out.clear();
+        if constexpr(std::is_integral_v<T> && std::is_integral_v<U>) {
+            std::size_t count = static_cast<std::size_t>(std::min<std::uintmax_t>(distance(start, end), batch_size));
+            out.resize(count);
+            for(std::size_t i = 0; i < count; ++i)
+                out[i] = static_cast<T>(start + i);
+            start += static_cast<T>(count);
+        } else {
+            while(out.size() < batch_size) {
+                std::optional<T> value = (*this)(start, end);
+                if(!value)
+                    break;
+                out.push_back(std::move(*value));
+            }
+        }
+        return !out.empty();
+    }
+
+    template<typename T, typename U>
+    constexpr stream_size size_hint(T &start, U &end) const {
+        if constexpr(std::is_integral_v<T> && std::is_integral_v<U>)
+            return stream_size::exactly(static_cast<std::size_t>(distance(start, end)));
+        else
+            return {};
+    }
+
+    // end - start, which may not fit in T (e.g. upto(-2000000000, 2000000000))
+    template<typename T, typename U>
+    static constexpr std::uintmax_t distance(T start, U end) {
+        return start < end ? static_cast<std::uintmax_t>(end) - static_cast<std::uintmax_t>(start) : 0;
+    }
 };
 struct upto_init {
     template<typename T>
     constexpr auto operator()(T &&end) const {
-        return std::make_tuple(T(), std::forward<T>(end));
+        return std::make_tuple(std::decay_t<T>(), std::forward<T>(end));
     }
 
     template<typename T, typename U>
@@ -98,6 +148,7 @@ struct downto_gen {
                 T ret = start;
                 start -= step;
                 return ret;
+            }
         } else {
             if(start != end) {
                 T ret = start;
@@ -132,6 +183,26 @@ struct mapping_op {
         else
             return std::optional<T>();
     }
+
+    template<typename Op, typename T, typename Func>
+    constexpr bool batch(Op &prev_op, std::vector<typename Op::value_type> &scratch, std::vector<T> &out, Func &f) const {
+        out.clear();
+        if(!next_batch(prev_op, scratch))
+            return false;
+
+        if constexpr(std::is_default_constructible_v<T>) {
+            out.resize(scratch.size());
+            for(std::size_t i = 0; i < scratch.size(); ++i)
+                out[i] = f(std::move(scratch[i]));
+        } else {
+            for(auto &value : scratch)
+                out.push_back(f(std::move(value)));
+        }
+        return true;
+    }
+
+    template<typename Op, typename Func>
+    constexpr stream_size size_hint(Op &prev_op, Func &) const { return detail::size_hint(prev_op); }
 };
 
 
@@ -140,12 +211,12 @@ struct flat_mapping_op {
     constexpr auto operator()(Op &prev_op, Func &f, Cont &cont, Pipe &pipe, It &it) const {
         while(cont || (cont = prev_op.next())) {
             if(!pipe) {
-                pipe = f(*cont);
-                it = std::begin(*pipe);
+                pipe.emplace(f(*cont));
+                it.emplace(std::begin(*pipe));
             }
 
             if(*it != std::end(*pipe))
-                return *(*it)++;
+                return std::optional(*(*it)++);
 
             pipe.reset();
             cont.reset();
@@ -163,6 +234,17 @@ struct flat_mapping_init {
 };
 
 
+template<typename Op, typename T, typename Pred>
+constexpr bool next_batch_where(Op &prev_op, std::vector<T> &out, Pred pred) {
+    while(next_batch(prev_op, out)) {
+        out.erase(std::remove_if(out.begin(), out.end(), [&](const T &value) { return !pred(value); }), out.end());
+        if(!out.empty())
+            return true;
+    }
+    return false;
+}
+
+
 struct filter_op {
     template<typename Op, typename Func>
     constexpr auto operator()(Op &prev_op, Func &f) const {
@@ -170,6 +252,14 @@ struct filter_op {
         while((value = prev_op.next()) && !f(*value)) {}
         return value;
     }
+
+    template<typename Op, typename Scratch, typename T, typename Func>
+    constexpr bool batch(Op &prev_op, Scratch &, std::vector<T> &out, Func &f) const {
+        return next_batch_where(prev_op, out, [&](const T &value) { return static_cast<bool>(f(value)); });
+    }
+
+    template<typename Op, typename Func>
+    constexpr stream_size size_hint(Op &prev_op, Func &) const { return detail::size_hint(prev_op).at_most(); }
 };
 
 
@@ -180,6 +270,14 @@ struct exclude_op {
         while((value = prev_op.next()) && f(*value)) {}
         return value;
     }
+
+    template<typename Op, typename Scratch, typename T, typename Func>
+    constexpr bool batch(Op &prev_op, Scratch &, std::vector<T> &out, Func &f) const {
+        return next_batch_where(prev_op, out, [&](const T &value) { return !f(value); });
+    }
+
+    template<typename Op, typename Func>
+    constexpr stream_size size_hint(Op &prev_op, Func &) const { return detail::size_hint(prev_op).at_most(); }
 };
 
 
@@ -192,6 +290,9 @@ struct adj_unique_op {
         prev_value = value;
         return value;
     }
+
+    template<typename Op>
+    constexpr stream_size size_hint(Op &prev_op, typename Op::value_opt_type &) const { return detail::size_hint(prev_op).at_most(); }
 };
 struct adj_unique_init {
     template<typename Op>
@@ -201,18 +302,93 @@ struct adj_unique_init {
 };
 
 
+struct limit_op {
+    template<typename Op>
+    constexpr typename Op::value_opt_type operator()(Op &prev_op, std::size_t &remaining) const {
+        if(remaining == 0)
+            return {};
+        --remaining;
+        return prev_op.next();
+    }
+
+    template<typename Op>
+    constexpr stream_size size_hint(Op &prev_op, std::size_t &remaining) const {
+        stream_size hint = detail::size_hint(prev_op);
+        if(hint.kind == stream_size::bound::unknown)
+            return stream_size{stream_size::bound::at_most, remaining};
+        return stream_size{hint.kind, std::min(hint.size, remaining)};
+    }
+};
+struct limit_init {
+    template<typename Src>
+    constexpr auto operator()(Src &, std::size_t count) const { return std::make_tuple(count); }
+};
+
+
 struct as_vector_term {
     template<typename Op>
     constexpr auto operator()(Op &prev_op) const {
-        return std::vector<typename Op::value_type>(std::begin(prev_op), std::end(prev_op));
+        using T = typename Op::value_type;
+
+        // an at_most hint may be far more than what's left after a filter, so isn't worth reserving
+        stream_size hint = size_hint(prev_op);
+        std::vector<T> result;
+        if(hint.kind == stream_size::bound::exact)
+            result.reserve(hint.size);
+
+        if constexpr(is_batched<Op>) {
+            std::vector<T> block;
+            while(prev_op.next_batch(block))
+                result.insert(result.end(), std::make_move_iterator(block.begin()), std::make_move_iterator(block.end()));
+        } else if(hint.kind == stream_size::bound::exact) {
+            // the hint may come from a user's generator, so is checked rather than trusted
+            while(auto value = prev_op.next()) {
+                if(result.size() < result.capacity())
+                    push_back_unchecked(result, std::move(*value));
+                else
+                    result.push_back(std::move(*value));
+            }
+        } else {
+            while(auto value = prev_op.next())
+                result.push_back(std::move(*value));
+        }
+        return result;
     }
 };
 
 
+template<typename T, typename = std::void_t<>>
+constexpr bool has_reserve = false;
+
+template<typename T>
+constexpr bool has_reserve<T, std::void_t<decltype(std::declval<T&>().reserve(std::size_t()))>> = true;
+
+template<typename T, typename It, typename = std::void_t<>>
+constexpr bool has_range_insert = false;
+
+template<typename T, typename It>
+constexpr bool has_range_insert<T, It, std::void_t<decltype(std::declval<T&>().insert(std::declval<T&>().end(), std::declval<It>(), std::declval<It>()))>> = true;
+
+
 template<typename T>
 struct as_term {
     template<typename Op>
     constexpr T operator()(Op &prev_op) const {
+        if constexpr(has_reserve<T>) {
+            stream_size hint = size_hint(prev_op);
+            if(hint.kind == stream_size::bound::exact) {
+                T result;
+                result.reserve(hint.size);
+                if constexpr(has_range_insert<T, decltype(std::begin(prev_op))>) {
+                    result.insert(result.end(), std::begin(prev_op), std::end(prev_op));
+                } else {
+                    // e.g. std::unordered_set, which has no insert(pos, first, last)
+                    for(auto &&value : prev_op)
+                        result.insert(std::forward<decltype(value)>(value));
+                }
+                return result;
+            }
+        }
         return T(std::begin(prev_op), std::end(prev_op));
     }
 };
@@ -238,7 +414,7 @@ struct single_term {
 struct last_term {
     template<typename Op>
     constexpr auto operator()(Op &prev_op) const {
-        typename Op::value_type value;
+        typename Op::value_opt_type value;
         while(auto next = prev_op.next())
             value = std::move(next);
         return value;
@@ -246,6 +422,114 @@ struct last_term {
 };
 
 
+// the terminals below stop pulling values as soon as the result is known
+
+struct take_term {
+    template<typename Op>
+    constexpr auto operator()(Op &prev_op, std::size_t count) const {
+        // count may be much more than the stream has (e.g. take(1'000'000'000)), so only a known size is reserved
+        std::vector<typename Op::value_type> result;
+        stream_size hint = size_hint(prev_op);
+        if(hint.kind == stream_size::bound::exact)
+            result.reserve(std::min(count, hint.size));
+
+        while(result.size() < count) {
+            auto value = prev_op.next();
+            if(!value)
+                break;
+            result.push_back(std::move(*value));
+        }
+        return result;
+    }
+};
+
+
+struct take_while_term {
+    template<typename Op, typename Func>
+    constexpr auto operator()(Op &prev_op, Func &f) const {
+        std::vector<typename Op::value_type> result;
+        while(auto value = prev_op.next()) {
+            if(!f(*value))
+                break;
+            result.push_back(std::move(*value));
+        }
+        return result;
+    }
+};
+
+
+struct find_if_term {
+    template<typename Op, typename Func>
+    constexpr auto operator()(Op &prev_op, Func &f) const {
+        while(auto value = prev_op.next())
+            if(f(*value))
+                return value;
+        return typename Op::value_opt_type();
+    }
+};
+
+
+struct any_of_term {
+    template<typename Op, typename Func>
+    constexpr bool operator()(Op &prev_op, Func &f) const {
+        while(auto value = prev_op.next())
+            if(f(*value))
+                return true;
+        return false;
+    }
+};
+
+
+struct all_of_term {
+    template<typename Op, typename Func>
+    constexpr bool operator()(Op &prev_op, Func &f) const {
+        while(auto value = prev_op.next())
+            if(!f(*value))
+                return false;
+        return true;
+    }
+};
+
+
+// whether op is a built-in source which knows exactly how many values it has, and can skip them without
+// anything else happening: upto over integers, or a container with random access iterators
+template<typename Op>
+constexpr bool is_exact_source = false;
+
+template<typename Init, typename PostInit, typename T, typename U>
+constexpr bool is_exact_source<gen<stream_gen<upto_gen, Init, PostInit>, std::tuple<T, U>>> = std::is_integral_v<T> && std::is_integral_v<U>;
+
+template<typename Init, typename Container, typename It>
+constexpr bool is_exact_source<gen<stream_gen<container_gen, Init, container_post_init>, std::tuple<Container, std::optional<It>>>> =
+    std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<It>::iterator_category>;
+
+
+// without a predicate, count only skips pulling the values when it's right after an exact source (see above).
+// otherwise every value is pulled, so the stages before it (e.g. a mapping with side effects) run for each,
+// and a size hint from a user's generator isn't trusted.
+struct count_term {
+    template<typename Op>
+    constexpr std::size_t operator()(Op &prev_op) const {
+        if constexpr(is_exact_source<Op>)
+            return size_hint(prev_op).size;
+
+        std::size_t count = 0;
+        while(prev_op.next())
+            ++count;
+        return count;
+    }
+
+    template<typename Op, typename Func>
+    constexpr std::size_t operator()(Op &prev_op, Func &f) const {
+        std::size_t count = 0;
+        while(auto value = prev_op.next())
+            if(f(*value))
+                ++count;
+        return count;
+    }
+};
+
+
 
 
 } // namespace detail
@@ -254,10 +538,13 @@ struct last_term {
 constexpr inline stream_gen upto{detail::upto_gen{}, detail::upto_init{}};
 constexpr inline stream_gen downto{detail::downto_gen{}, detail::downto_init{}};
 constexpr inline stream_op mapping{detail::mapping_op{}};
+// the stream returned by flat_mapping's function must not refer to its parameters: upto(x) keeps a
+// reference to x, which dangles once the function returns, so pass a copy instead (e.g. upto(+x))
 constexpr inline stream_op flat_mapping{detail::flat_mapping_op{}, detail::flat_mapping_init{}};
 constexpr inline stream_op filter{detail::filter_op{}};
 constexpr inline stream_op exclude{detail::exclude_op{}};
 constexpr inline stream_op adj_unique{detail::adj_unique_op{}, detail::adj_unique_init{}};  // TODO: move to extra.hpp
+constexpr inline stream_op limit{detail::limit_op{}, detail::limit_init{}};  // unbounded
 constexpr inline stream_term as_vector{detail::as_vector_term{}};
 
 template<typename T>
@@ -266,6 +553,12 @@ constexpr stream_term as{detail::as_term<T>{}};
 constexpr inline stream_term first{detail::first_term{}};   // unbounded
 constexpr inline stream_term single{detail::single_term{}};  // unbounded
 constexpr inline stream_term last{detail::last_term{}};
+constexpr inline stream_term take{detail::take_term{}};               // unbounded
+constexpr inline stream_term take_while{detail::take_while_term{}};   // unbounded
+constexpr inline stream_term find_if{detail::find_if_term{}};         // unbounded
+constexpr inline stream_term any_of{detail::any_of_term{}};           // unbounded
+constexpr inline stream_term all_of{detail::all_of_term{}};           // unbounded
+constexpr inline stream_term count{detail::count_term{}};
 
 } // namespace stream
 
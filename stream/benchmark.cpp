@@ -0,0 +1,219 @@
+// build with optimizations, e.g.:  g++ -std=c++20 -O2 -pthread benchmark.cpp
+#include "basic.hpp"
+#include "../alloc_counter/alloc_counter.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <ranges>
+#include <string>
+#include <vector>
+
+
+using namespace stream;
+
+constexpr int runs = 5;
+
+
+// runs f (which returns a checksum) a few times, and reports the fastest run
+template<typename F>
+std::uint64_t measure(const char *workload, const char *variant, std::size_t elements, F f) {
+    using clock = std::chrono::steady_clock;
+
+    double best = 1e300;
+    std::size_t count = 0, bytes = 0;
+    std::uint64_t checksum = 0;
+
+    for(int i = 0; i < runs; ++i) {
+        std::size_t base_count = alloc_counter::count, base_bytes = alloc_counter::total_bytes;
+        auto start = clock::now();
+        checksum = f();
+        best = std::min(best, std::chrono::duration<double>(clock::now() - start).count());
+        count = alloc_counter::count - base_count;
+        bytes = alloc_counter::total_bytes - base_bytes;
+    }
+
+    std::cout << std::left << std::setw(22) << workload << std::setw(8) << variant << std::right << std::fixed
+              << std::setw(12) << std::setprecision(2) << best * 1e9 / elements
+              << std::setw(12) << count
+              << std::setw(14) << std::setprecision(1) << bytes / 1048576.0 << '\n';
+    return checksum;
+}
+
+
+template<typename... Checksums>
+void check(const char *workload, std::uint64_t expected, Checksums... checksums) {
+    if(((checksums != expected) || ...))
+        std::cout << "*** " << workload << ": the results differ\n";
+}
+
+
+template<typename Container>
+std::uint64_t checksum_of(const Container &values) {
+    std::uint64_t sum = values.size();
+    for(auto &value : values)
+        sum = sum * 31 + static_cast<std::uint64_t>(value);
+    return sum;
+}
+
+std::uint64_t checksum_of(const std::vector<std::string> &values) {
+    std::uint64_t sum = values.size();
+    for(auto &value : values)
+        for(char c : value)
+            sum = sum * 31 + static_cast<unsigned char>(c);
+    return sum;
+}
+
+
+
+void map_filter(int n) {
+    auto triple = [](int x) { return x * 3; };
+    auto odd = [](int x) { return x % 2 != 0; };
+
+    std::uint64_t loop = measure("upto|map|filter", "loop", n, [&] {
+        std::vector<int> out;
+        for(int i = 0; i < n; ++i) {
+            int x = triple(i);
+            if(odd(x))
+                out.push_back(x);
+        }
+        return checksum_of(out);
+    });
+
+    std::uint64_t ranges = measure("upto|map|filter", "ranges", n, [&] {
+        std::vector<int> out;
+        for(int x : std::views::iota(0, n) | std::views::transform(triple) | std::views::filter(odd))
+            out.push_back(x);
+        return checksum_of(out);
+    });
+
+    std::uint64_t streamed = measure("upto|map|filter", "stream", n, [&] {
+        return checksum_of(upto(0, n) | mapping(triple) | filter(odd) | as_vector);
+    });
+
+    check("upto|map|filter", loop, ranges, streamed);
+}
+
+
+void fan_out(int n) {
+    auto fan = [](int x) { return x % 16; };
+    std::size_t elements = 0;
+    for(int i = 0; i < n; ++i)
+        elements += fan(i);
+
+    std::uint64_t loop = measure("flat_mapping fan-out", "loop", elements, [&] {
+        std::uint64_t sum = 0;
+        for(int i = 0; i < n; ++i)
+            for(int j = 0; j < fan(i); ++j)
+                sum += j;
+        return sum;
+    });
+
+    std::uint64_t ranges = measure("flat_mapping fan-out", "ranges", elements, [&] {
+        std::uint64_t sum = 0;
+        for(int j : std::views::iota(0, n) | std::views::transform([&](int x) { return std::views::iota(0, fan(x)); }) | std::views::join)
+            sum += j;
+        return sum;
+    });
+
+    std::uint64_t streamed = measure("flat_mapping fan-out", "stream", elements, [&] {
+        std::uint64_t sum = 0;
+        for(int j : upto(0, n) | flat_mapping([&](int x) { return upto(0, fan(x)); }))
+            sum += j;
+        return sum;
+    });
+
+    check("flat_mapping fan-out", loop, ranges, streamed);
+}
+
+
+void unique_sorted(int n, std::mt19937 &rng) {
+    std::vector<int> sorted_values(n);
+    std::uniform_int_distribution<int> value(0, n / 4);
+    for(int &x : sorted_values)
+        x = value(rng);
+    std::sort(sorted_values.begin(), sorted_values.end());
+
+    std::uint64_t loop = measure("adj_unique", "loop", n, [&] {
+        std::vector<int> out;
+        for(std::size_t i = 0; i < sorted_values.size(); ++i)
+            if(i == 0 || sorted_values[i] != sorted_values[i - 1])
+                out.push_back(sorted_values[i]);
+        return checksum_of(out);
+    });
+
+    // C++20 has no chunk_by, so compare each value with the one before it
+    std::uint64_t ranges = measure("adj_unique", "ranges", n, [&] {
+        std::vector<int> out;
+        auto first_of_run = [&](std::size_t i) { return i == 0 || sorted_values[i] != sorted_values[i - 1]; };
+        for(int x : std::views::iota(std::size_t(0), sorted_values.size()) | std::views::filter(first_of_run)
+                  | std::views::transform([&](std::size_t i) { return sorted_values[i]; }))
+            out.push_back(x);
+        return checksum_of(out);
+    });
+
+    std::uint64_t streamed = measure("adj_unique", "stream", n, [&] {
+        return checksum_of(sorted_values | adj_unique | as_vector);
+    });
+
+    check("adj_unique", loop, ranges, streamed);
+}
+
+
+void string_transform(int n, std::mt19937 &rng) {
+    std::vector<std::string> words(n);
+    std::uniform_int_distribution<int> length(1, 12), letter('a', 'z');
+    for(std::string &word : words)
+        for(int i = length(rng); i > 0; --i)
+            word += static_cast<char>(letter(rng));
+
+    auto upper = [](const std::string &word) {
+        std::string result = word;
+        for(char &c : result)
+            c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        return result;
+    };
+    auto longer = [](const std::string &word) { return word.size() > 6; };
+
+    std::uint64_t loop = measure("string transform", "loop", n, [&] {
+        std::vector<std::string> out;
+        for(const std::string &word : words) {
+            std::string u = upper(word);
+            if(longer(u))
+                out.push_back(std::move(u));
+        }
+        return checksum_of(out);
+    });
+
+    std::uint64_t ranges = measure("string transform", "ranges", n, [&] {
+        std::vector<std::string> out;
+        for(std::string u : words | std::views::transform(upper) | std::views::filter(longer))
+            out.push_back(std::move(u));
+        return checksum_of(out);
+    });
+
+    std::uint64_t streamed = measure("string transform", "stream", n, [&] {
+        return checksum_of(words | mapping(upper) | filter(longer) | as_vector);
+    });
+
+    check("string transform", loop, ranges, streamed);
+}
+
+
+
+int main() {
+    std::mt19937 rng(12345);
+
+    std::cout << std::left << std::setw(22) << "workload" << std::setw(8) << "variant" << std::right
+              << std::setw(12) << "ns/element" << std::setw(12) << "allocs" << std::setw(14) << "alloc MB" << '\n';
+
+    map_filter(10000000);
+    fan_out(2000000);
+    unique_sorted(10000000, rng);
+    string_transform(1000000, rng);
+}
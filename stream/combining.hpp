@@ -0,0 +1,170 @@
+#ifndef LIPH_STREAM_COMBINING_HPP
+#define LIPH_STREAM_COMBINING_HPP
+
+#include "sorting.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+/* merge(streams...) and merge(streams..., comp) generate the values of several sorted streams in order,
+ * going through a loser tree, so each value costs about log2(number of streams) comparisons. Ties go to
+ * the stream listed first.
+ *
+ * zip(streams...) generates a std::tuple of the next value of each stream, until any of them runs out.
+ *
+ * The streams can be containers (which are referenced rather than copied when they're lvalues, just like
+ * with operator|), stream_gens or pipes:
+ *
+ *     for(auto [id, name] : zip(upto(1, unbounded), names))
+ *         ...
+ *     std::vector<int> all = merge(shard1, shard2, shard3 | filter(valid), std::greater<>()) | as_vector;
+ */
+
+namespace stream {
+
+
+namespace detail {
+
+
+template<typename T>
+constexpr bool is_stream_gen = false;
+
+template<typename... Args>
+constexpr bool is_stream_gen<stream_gen<Args...>> = true;
+
+
+template<typename T, typename = std::void_t<>>
+constexpr bool has_next = false;
+
+template<typename T>
+constexpr bool has_next<T, std::void_t<decltype(std::declval<T&>().next())>> = true;
+
+
+template<typename T, typename = std::void_t<>>
+constexpr bool is_container = false;
+
+template<typename T>
+constexpr bool is_container<T, std::void_t<decltype(std::begin(std::declval<T&>()))>> = true;
+
+
+// anything which can be passed to merge or zip as a stream (and so isn't a comparison function)
+template<typename T>
+constexpr bool is_stream_source = has_next<std::decay_t<T>> || is_stream_gen<std::decay_t<T>> || is_container<std::decay_t<T>>;
+
+
+template<typename T>
+constexpr auto to_source(T &&s) {
+    if constexpr(has_next<std::decay_t<T>>)
+        return std::decay_t<T>(std::forward<T>(s));
+    else if constexpr(is_stream_gen<std::decay_t<T>>)
+        return gen(std::forward<T>(s));
+    else
+        return gen(container(std::forward<T>(s)));
+}
+
+
+// sources.get<i>().next(), for an i only known at runtime
+template<typename T, typename Sources, std::size_t... Is>
+std::optional<T> next_at(Sources &sources, std::size_t i, std::index_sequence<Is...>) {
+    std::optional<T> value;
+    ((Is == i ? void(value = std::get<Is>(sources).next()) : void()), ...);
+    return value;
+}
+
+
+struct merge_gen {
+    template<typename... Srcs, typename Comp, typename T>
+    std::optional<T> operator()(std::tuple<Srcs...> &sources, Comp &comp, std::optional<loser_tree<T, Comp>> &tree) const {
+        // the first values aren't pulled until they're needed
+        if(!tree) {
+            std::vector<std::optional<T>> heads;
+            heads.reserve(sizeof...(Srcs));
+            std::apply([&](auto&... src) { (heads.emplace_back(src.next()), ...); }, sources);
+            tree.emplace(std::move(heads), comp);
+        }
+
+        return tree->pop([&](std::size_t i) { return next_at<T>(sources, i, std::index_sequence_for<Srcs...>()); });
+    }
+};
+struct merge_init {
+    template<typename First, typename... Args>
+    auto operator()(First &&first, Args&&... args) const {
+        constexpr std::size_t count = sizeof...(Args) + 1;
+        auto all = std::forward_as_tuple(std::forward<First>(first), std::forward<Args>(args)...);
+
+        if constexpr(is_stream_source<std::tuple_element_t<count - 1, std::tuple<First, Args...>>>)
+            return make_params(std::less<>(), std::move(all), std::make_index_sequence<count>());
+        else
+            return make_params(std::get<count - 1>(all), std::move(all), std::make_index_sequence<count - 1>());
+    }
+
+private:
+    template<typename Comp, typename All, std::size_t... Is>
+    static auto make_params(Comp comp, All &&all, std::index_sequence<Is...>) {
+        auto sources = std::make_tuple(to_source(std::get<Is>(std::move(all)))...);
+        using T = std::common_type_t<typename std::tuple_element_t<Is, decltype(sources)>::value_type...>;
+        return std::make_tuple(std::move(sources), std::move(comp), std::optional<loser_tree<T, Comp>>());
+    }
+};
+
+
+struct zip_gen {
+    template<typename... Srcs>
+    std::optional<std::tuple<typename Srcs::value_type...>> operator()(std::tuple<Srcs...> &sources) const {
+        return std::apply([](auto&... src) -> std::optional<std::tuple<typename Srcs::value_type...>> {
+            // braced initialization pulls from the streams in order
+            std::tuple<typename Srcs::value_opt_type...> values{src.next()...};
+            if(!std::apply([](auto&... value) { return (static_cast<bool>(value) && ...); }, values))
+                return {};
+            return std::apply([](auto&... value) { return std::tuple<typename Srcs::value_type...>(std::move(*value)...); }, values);
+        }, sources);
+    }
+
+    template<typename... Srcs>
+    stream_size size_hint(std::tuple<Srcs...> &sources) const {
+        bool known = false, exact = true;
+        std::size_t size = std::numeric_limits<std::size_t>::max();
+
+        std::apply([&](auto&... src) {
+            for(stream_size hint : {detail::size_hint(src)...}) {
+                if(hint.kind == stream_size::bound::unknown) {
+                    exact = false;
+                    continue;
+                }
+                known = true;
+                exact = exact && hint.kind == stream_size::bound::exact;
+                size = std::min(size, hint.size);
+            }
+        }, sources);
+
+        if(!known)
+            return {};
+        return stream_size{exact ? stream_size::bound::exact : stream_size::bound::at_most, size};
+    }
+};
+struct zip_init {
+    template<typename First, typename... Args>
+    auto operator()(First &&first, Args&&... args) const {
+        return std::make_tuple(std::make_tuple(to_source(std::forward<First>(first)), to_source(std::forward<Args>(args))...));
+    }
+};
+
+
+} // namespace detail
+
+
+constexpr inline stream_gen merge{detail::merge_gen{}, detail::merge_init{}};
+constexpr inline stream_gen zip{detail::zip_gen{}, detail::zip_init{}};
+
+
+} // namespace stream
+
+#endif
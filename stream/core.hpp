@@ -1,6 +1,7 @@
 #ifndef LIPH_STREAM_CORE_HPP
 #define LIPH_STREAM_CORE_HPP
 
+#include <algorithm>
 #include <cstddef>
 #include <functional>
 #include <iterator>
@@ -10,6 +11,7 @@
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 
 namespace stream {
@@ -109,6 +111,19 @@ struct iterator {
     constexpr explicit iterator(Pipe *p) : gen(), pipe(p), value(pipe->next()) {}
     constexpr explicit iterator(Gen &&g) : gen(std::move(g)), pipe(&*gen), value(pipe->next()) {}
 
+    // when the iterator owns the generator, pipe has to point at the copy's own generator
+    constexpr iterator(const iterator &other) : gen(other.gen), pipe(own_pipe(other.pipe)), value(other.value) {}
+    constexpr iterator(iterator &&other) : gen(std::move(other.gen)), pipe(own_pipe(other.pipe)), value(std::move(other.value)) {}
+
+    constexpr iterator &operator=(iterator other) {
+        gen.reset();
+        if(other.gen)
+            gen.emplace(std::move(*other.gen));
+        pipe = own_pipe(other.pipe);
+        value = std::move(other.value);
+        return *this;
+    }
+
     constexpr iterator &operator++() { value = pipe->next(); return *this; }
 
     constexpr iterator operator++(int) {
@@ -119,6 +134,14 @@ struct iterator {
 
     constexpr typename ValueType::value_type &operator*() { return *value; }
 
+    constexpr Pipe *own_pipe(Pipe *other_pipe) {
+        if constexpr(std::is_same_v<Gen, Pipe>) {
+            if(gen)
+                return &*gen;
+        }
+        return other_pipe;
+    }
+
     std::optional<Gen> gen;
     Pipe *pipe;
     ValueType value;
@@ -137,6 +160,132 @@ constexpr bool operator!=(const iterator<Pipe, Gen, ValueType> &left, const iter
 
 
 
+// terminals may return things without a value_type (or nothing at all)
+template<typename T, typename = std::void_t<>>
+struct value_type_of { using type = void; };
+
+template<typename T>
+struct value_type_of<T, std::void_t<typename T::value_type>> { using type = typename T::value_type; };
+
+
+
+/* Besides next(), streams can be pulled a block at a time with next_batch(out), which replaces the contents of
+ * out with up to batch_size values and returns false (with out empty) once the stream has ended. 
+ * Generators and operations which can handle a whole block at once (in a loop the compiler can vectorize)
+ * provide a batch() member alongside operator():
+ *
+ *     generators: bool batch(std::vector<T> &out, Params&... params)
+ *     operations: bool batch(Op &prev_op, std::vector<typename Op::value_type> &scratch, std::vector<T> &out, Params&... params)
+ *
+ * scratch is a buffer owned by the pipe for operations which change the type of the values. Everything without
+ * a batch() falls back to calling next() batch_size times, so the two can be mixed freely.
+ */
+constexpr inline std::size_t batch_size = 256;
+
+
+template<typename Op, typename = std::void_t<>>
+constexpr bool has_next_batch = false;
+
+template<typename Op>
+constexpr bool has_next_batch<Op, std::void_t<decltype(std::declval<Op&>().next_batch(
+        std::declval<std::vector<typename Op::value_type>&>()))>> = true;
+
+// true if the last stage of Op has its own batch, so next_batch does better than calling next() repeatedly.
+// the stages before it aren't checked, and may still fill their batches with next().
+template<typename Op, typename = std::void_t<>>
+constexpr bool is_batched = false;
+
+template<typename Op>
+constexpr bool is_batched<Op, std::void_t<decltype(Op::batched)>> = Op::batched;
+
+
+template<typename Op, typename T>
+constexpr bool next_scalar_batch(Op &op, std::vector<T> &out) {
+    out.clear();
+    while(out.size() < batch_size) {
+        auto value = op.next();
+        if(!value)
+            break;
+        out.push_back(std::move(*value));
+    }
+    return !out.empty();
+}
+
+template<typename Op, typename T>
+constexpr bool next_batch(Op &op, std::vector<T> &out) {
+    if constexpr(has_next_batch<Op>)
+        return op.next_batch(out);
+    else
+        return next_scalar_batch(op, out);
+}
+
+
+template<typename Src, typename Out, typename Params, typename = std::void_t<>>
+constexpr bool can_gen_batch = false;
+
+template<typename Src, typename Out, typename... Params>
+constexpr bool can_gen_batch<Src, Out, std::tuple<Params...>, std::void_t<decltype(std::declval<Src&>().run_batch(
+        std::declval<Out&>(), std::declval<Params&>()...))>> = true;
+
+template<typename Dest, typename Src, typename Scratch, typename Out, typename Params, typename = std::void_t<>>
+constexpr bool can_op_batch = false;
+
+template<typename Dest, typename Src, typename Scratch, typename Out, typename... Params>
+constexpr bool can_op_batch<Dest, Src, Scratch, Out, std::tuple<Params...>, std::void_t<decltype(std::declval<Dest&>().run_batch(
+        std::declval<Src&>(), std::declval<Scratch&>(), std::declval<Out&>(), std::declval<Params&>()...))>> = true;
+
+
+
+/* size_hint() tells how many values are left in a stream, so that terminals can reserve space up front. 
+ * Generators and operations which know provide a size_hint() member alongside operator():
+ *
+ *     generators: stream_size size_hint(Params&... params)
+ *     operations: stream_size size_hint(Op &prev_op, Params&... params)
+ */
+struct stream_size {
+    enum class bound { exact, at_most, unknown };
+
+    bound kind = bound::unknown;
+    std::size_t size = 0;
+
+    static constexpr stream_size exactly(std::size_t size) { return {bound::exact, size}; }
+
+    // what remains once some of the values may be dropped
+    constexpr stream_size at_most() const { return kind == bound::unknown ? *this : stream_size{bound::at_most, size}; }
+};
+
+
+template<typename Op, typename = std::void_t<>>
+constexpr bool has_size_hint = false;
+
+template<typename Op>
+constexpr bool has_size_hint<Op, std::void_t<decltype(std::declval<Op&>().size_hint())>> = true;
+
+template<typename Op>
+constexpr stream_size size_hint(Op &op) {
+    if constexpr(has_size_hint<Op>)
+        return op.size_hint();
+    else
+        return {};
+}
+
+
+template<typename Src, typename Params, typename = std::void_t<>>
+constexpr bool can_gen_size_hint = false;
+
+template<typename Src, typename... Params>
+constexpr bool can_gen_size_hint<Src, std::tuple<Params...>, std::void_t<decltype(std::declval<Src&>().run_size_hint(
+        std::declval<Params&>()...))>> = true;
+
+template<typename Dest, typename Src, typename Params, typename = std::void_t<>>
+constexpr bool can_op_size_hint = false;
+
+template<typename Dest, typename Src, typename... Params>
+constexpr bool can_op_size_hint<Dest, Src, std::tuple<Params...>, std::void_t<decltype(std::declval<Dest&>().run_size_hint(
+        std::declval<Src&>(), std::declval<Params&>()...))>> = true;
+
+
+
 template<typename Src, typename Params = decltype(std::declval<Src>().init())>
 struct gen {
     constexpr explicit gen(Src s) : src(std::move(s)), params(src.init()) {
@@ -150,7 +299,23 @@ struct gen {
 
     using iterator = detail::iterator<gen, gen>;
     using value_opt_type = decltype(std::declval<gen<Src>>().next());
-    using value_type = typename value_opt_type::value_type;
+    using value_type = typename value_type_of<value_opt_type>::type;
+
+    static constexpr bool batched = can_gen_batch<Src, std::vector<value_type>, Params>;
+
+    constexpr bool next_batch(std::vector<value_type> &out) {
+        if constexpr(batched)
+            return std::apply([&](auto&... p) { return src.run_batch(out, p...); }, params);
+        else
+            return next_scalar_batch(*this, out);
+    }
+
+    constexpr stream_size size_hint() {
+        if constexpr(can_gen_size_hint<Src, Params>)
+            return std::apply([&](auto&... p) { return src.run_size_hint(p...); }, params);
+        else
+            return {};
+    }
     
     constexpr iterator begin() { return iterator(this); }
     constexpr iterator end() { return iterator(); }
@@ -175,7 +340,26 @@ struct pipe {
     
     using iterator = detail::iterator<pipe>;
     using value_opt_type = decltype(std::declval<pipe>().next());
-    using value_type = typename value_opt_type::value_type;
+    using value_type = typename value_type_of<value_opt_type>::type;
+    using scratch_type = std::vector<typename Src::value_type>;
+
+    scratch_type scratch;
+
+    static constexpr bool batched = can_op_batch<Dest, Src, scratch_type, std::vector<value_type>, Params>;
+
+    constexpr bool next_batch(std::vector<value_type> &out) {
+        if constexpr(batched)
+            return std::apply([&](auto&... p) { return dest.run_batch(src, scratch, out, p...); }, params);
+        else
+            return next_scalar_batch(*this, out);
+    }
+
+    constexpr stream_size size_hint() {
+        if constexpr(can_op_size_hint<Dest, Src, Params>)
+            return std::apply([&](auto&... p) { return dest.run_size_hint(src, p...); }, params);
+        else
+            return {};
+    }
     
     constexpr iterator begin() { return iterator(this); }
     constexpr iterator end() { return iterator(); }
@@ -201,6 +385,12 @@ public:
     template<typename... Args>
     constexpr auto run(Args&... args) { return func(args...); }
 
+    template<typename... Args, typename F = Func>
+    constexpr auto run_batch(Args&... args) -> decltype(std::declval<F&>().batch(args...)) { return func.batch(args...); }
+
+    template<typename... Args, typename F = Func>
+    constexpr auto run_size_hint(Args&... args) -> decltype(std::declval<F&>().size_hint(args...)) { return func.size_hint(args...); }
+
     constexpr auto init() { return init_func(); }
 
     template<typename... Args>
@@ -328,6 +518,12 @@ public:
     template<typename... Args>
     constexpr auto run(Args&... args) { return func(args...); }
 
+    template<typename... Args, typename F = Func>
+    constexpr auto run_batch(Args&... args) -> decltype(std::declval<F&>().batch(args...)) { return func.batch(args...); }
+
+    template<typename... Args, typename F = Func>
+    constexpr auto run_size_hint(Args&... args) -> decltype(std::declval<F&>().size_hint(args...)) { return func.size_hint(args...); }
+
     template<typename Src>
     constexpr auto init(Src &src) { return init_func(src); }
 
@@ -348,6 +544,28 @@ public:
     constexpr stream_term(Func f) : stream_op<Func, InitFunc, PostInitFunc>(std::move(f)) {}
     constexpr stream_term(Func f, InitFunc i) : stream_op<Func, InitFunc, PostInitFunc>(std::move(f), std::move(i)) {} 
     constexpr stream_term(Func f, InitFunc i, PostInitFunc p) : stream_op<Func, InitFunc, PostInitFunc>(std::move(f), std::move(i), std::move(p)) {} 
+    constexpr explicit stream_term(stream_op<Func, InitFunc, PostInitFunc> op) : stream_op<Func, InitFunc, PostInitFunc>(std::move(op)) {}
+
+    // passing arguments to a terminal must still give a terminal
+    constexpr const stream_term &operator()() const { return *this; }
+
+    template<typename... Args>
+    constexpr auto operator()(Args&&... args) const {
+        return make_term(stream_op<Func, InitFunc, PostInitFunc>::operator()(std::forward<Args>(args)...));
+    }
+
+    constexpr stream_term &operator()() { return *this; }
+
+    template<typename... Args>
+    constexpr auto operator()(Args&&... args) {
+        return make_term(stream_op<Func, InitFunc, PostInitFunc>::operator()(std::forward<Args>(args)...));
+    }
+
+private:
+    template<typename Func2, typename InitFunc2, typename PostInitFunc2>
+    static constexpr auto make_term(stream_op<Func2, InitFunc2, PostInitFunc2> op) {
+        return stream_term<Func2, InitFunc2, PostInitFunc2>(std::move(op));
+    }
 };
 
 
@@ -376,6 +594,31 @@ struct container_gen {
         opt.reset();
         return ret;
     }
+
+    template<typename T, typename Container, typename It>
+    constexpr bool batch(std::vector<T> &out, Container &cont, std::optional<It> &current) const {
+        It &it = *current;
+        auto last = std::end(cont);
+
+        if constexpr(std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<It>::iterator_category>) {
+            std::size_t count = std::min<std::size_t>(last - it, batch_size);
+            out.assign(it, it + count);
+            it += count;
+        } else {
+            out.clear();
+            while(out.size() < batch_size && it != last)
+                out.push_back(*it++);
+        }
+        return !out.empty();
+    }
+
+    template<typename Container, typename It>
+    constexpr stream_size size_hint(Container &cont, std::optional<It> &current) const {
+        if constexpr(std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<It>::iterator_category>)
+            return stream_size::exactly(std::end(cont) - *current);
+        else
+            return {};
+    }
 };
 struct container_init {
     template<typename Container>
@@ -0,0 +1,324 @@
+#ifndef LIPH_STREAM_HASHING_HPP
+#define LIPH_STREAM_HASHING_HPP
+
+#include "core.hpp"
+#include "spill.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+/* distinct removes every value which has been seen before (not just adjacent ones, like adj_unique), using
+ * an open-addressing hash set. distinct(approximate{expected_count, false_positive_rate}) uses a Bloom
+ * filter instead, which takes a fixed amount of memory but wrongly drops about false_positive_rate of the
+ * values it hasn't seen before once expected_count values have gone through.
+ *
+ * group_by(key) collects the values into a std::vector<std::pair<Key, std::vector<T>>>, and
+ * group_by(key, init, combine) folds each group with acc = combine(std::move(acc), value), starting from
+ * init. The groups are in no particular order. Once the groups take more than the memory budget (pass
+ * memory_budget{bytes} as the last argument; 256MB by default), values of keys which aren't already in
+ * memory are written to temporary files, split up by the hash of their key, and each file is grouped
+ * on its own afterwards. The groups are measured as the hash table, what the keys own (e.g. the characters
+ * of a std::string key) and, for group_by(key), the values collected; what a combined accumulator owns
+ * isn't counted. Spilled values are written as raw bytes, so the budget only applies when T is trivially
+ * copyable or a std::string.
+ *
+ *     auto totals = orders
+ *         | group_by([](const order &o) { return o.customer_id; }, 0.0,
+ *                    [](double total, const order &o) { return total + o.price; });
+ */
+
+namespace stream {
+
+
+struct approximate {
+    std::size_t expected_count;
+    double false_positive_rate = 0.01;
+};
+
+
+namespace detail {
+
+
+inline std::uint64_t mix_hash(std::uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// std::hash is often the identity for integers, so the bits are mixed before being used. different
+// seeds give unrelated hashes of the same value.
+template<typename T>
+std::uint64_t hash_value(const T &value, std::uint64_t seed = 0) {
+    return mix_hash(std::hash<T>{}(value) ^ (seed * 0x9e3779b97f4a7c15ULL));
+}
+
+
+// open addressing with linear probing, kept at most half full
+template<typename K, typename V>
+class flat_hash_map {
+public:
+    using value_type = std::pair<K, V>;
+
+    flat_hash_map() : slots(16), count(0) {}
+
+    // returns the value for key, creating it with make_value() if key isn't in the map, and whether it was created
+    template<typename MakeValue>
+    std::pair<V*, bool> try_emplace(const K &key, MakeValue &&make_value) {
+        if((count + 1) * 2 > slots.size())
+            grow();
+
+        std::optional<value_type> &slot = slots[find(key)];
+        if(slot)
+            return {&slot->second, false};
+
+        slot.emplace(key, make_value());
+        ++count;
+        return {&slot->second, true};
+    }
+
+    V *find_value(const K &key) {
+        std::optional<value_type> &slot = slots[find(key)];
+        return slot ? &slot->second : nullptr;
+    }
+
+    std::size_t size() const { return count; }
+
+    std::size_t memory_bytes() const { return slots.size() * sizeof(std::optional<value_type>); }
+
+    template<typename Out>
+    void move_to(Out &out) {
+        for(auto &slot : slots)
+            if(slot)
+                out.push_back(std::move(*slot));
+        slots.assign(16, std::nullopt);
+        count = 0;
+    }
+
+private:
+    std::size_t find(const K &key) const {
+        std::size_t mask = slots.size() - 1;
+        std::size_t i = hash_value(key) & mask;
+
+        while(slots[i] && !(slots[i]->first == key))
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    void grow() {
+        std::vector<std::optional<value_type>> old(slots.size() * 2);
+        std::swap(old, slots);
+
+        for(auto &slot : old)
+            if(slot)
+                slots[find(slot->first)] = std::move(slot);
+    }
+
+    std::vector<std::optional<value_type>> slots;
+    std::size_t count;
+};
+
+
+template<typename T>
+class flat_hash_set {
+    struct empty {};
+
+public:
+    // returns false if value was already in the set
+    bool insert(const T &value) { return table.try_emplace(value, [] { return empty(); }).second; }
+
+    std::size_t size() const { return table.size(); }
+
+private:
+    flat_hash_map<T, empty> table;
+};
+
+
+class bloom_filter {
+public:
+    bloom_filter(std::size_t expected_count, double false_positive_rate) {
+        constexpr double ln2 = 0.6931471805599453;
+
+        double n = static_cast<double>(std::max<std::size_t>(expected_count, 1));
+        double p = std::min(std::max(false_positive_rate, 1e-12), 0.5);
+        double bits = -n * std::log(p) / (ln2 * ln2);
+
+        words.assign(std::max<std::size_t>(static_cast<std::size_t>(std::ceil(bits / 64)), 1), 0);
+        hash_count = static_cast<std::size_t>(std::min(std::max(std::round(bits / n * ln2), 1.0), 30.0));
+    }
+
+    // returns false if the hash may have been inserted before
+    bool insert(std::uint64_t hash) {
+        std::uint64_t step = mix_hash(hash) | 1;
+        std::uint64_t bit_count = words.size() * 64;
+        bool added = false;
+
+        for(std::size_t i = 0; i < hash_count; ++i, hash += step) {
+            std::uint64_t bit = hash % bit_count;
+            std::uint64_t mask = std::uint64_t(1) << (bit % 64);
+            if(!(words[bit / 64] & mask)) {
+                words[bit / 64] |= mask;
+                added = true;
+            }
+        }
+        return added;
+    }
+
+private:
+    std::vector<std::uint64_t> words;
+    std::size_t hash_count;
+};
+
+
+struct distinct_op {
+    template<typename Op, typename T>
+    typename Op::value_opt_type operator()(Op &prev_op, flat_hash_set<T> &seen) const {
+        while(auto value = prev_op.next())
+            if(seen.insert(*value))
+                return value;
+        return {};
+    }
+
+    template<typename Op>
+    typename Op::value_opt_type operator()(Op &prev_op, bloom_filter &seen) const {
+        while(auto value = prev_op.next())
+            if(seen.insert(hash_value(*value)))
+                return value;
+        return {};
+    }
+
+    template<typename Op, typename Seen>
+    stream_size size_hint(Op &prev_op, Seen &) const { return detail::size_hint(prev_op).at_most(); }
+};
+struct distinct_init {
+    template<typename Src>
+    auto operator()(Src &) const { return std::make_tuple(flat_hash_set<typename Src::value_type>()); }
+
+    template<typename Src>
+    auto operator()(Src &, approximate a) const {
+        return std::make_tuple(bloom_filter(a.expected_count, a.false_positive_rate));
+    }
+};
+
+
+
+template<typename T, typename KeyFunc, typename Agg, typename Combine>
+class grouper {
+public:
+    using key_type = std::decay_t<std::invoke_result_t<KeyFunc&, const T&>>;
+    using result_type = std::vector<std::pair<key_type, Agg>>;
+
+    static constexpr std::size_t partition_count = 16;
+    static constexpr std::size_t max_depth = 4;   // after which the budget is ignored
+
+    grouper(KeyFunc &key, const Agg &init, Combine &combine, std::size_t budget)
+        : key(key), init(init), combine(combine), budget(budget) {}
+
+    // next() returns the next value to group, or an empty optional at the end
+    template<typename Next>
+    void run(Next &&next, std::size_t depth, result_type &result) {
+        flat_hash_map<key_type, Agg> groups;
+        std::vector<temp_file> partitions;
+        std::size_t owned_bytes = 0;   // by the keys, and by the values for group_by(key)
+
+        while(std::optional<T> value = next()) {
+            key_type k = key(std::as_const(*value));
+
+            if(partitions.empty()) {
+                auto [agg, added] = groups.try_emplace(k, [&] { return init; });
+                if constexpr(is_spillable<T>) {
+                    // the slots themselves are counted by memory_bytes()
+                    if(added)
+                        owned_bytes += held_bytes(k) - sizeof k;
+                    if constexpr(std::is_same_v<Agg, std::vector<T>>)
+                        owned_bytes += held_bytes(*value);
+                }
+                *agg = combine(std::move(*agg), std::move(*value));
+
+                if constexpr(is_spillable<T>) {
+                    if(depth < max_depth && groups.memory_bytes() + owned_bytes > budget)
+                        partitions = open_partitions();
+                }
+            } else if(Agg *agg = groups.find_value(k)) {
+                *agg = combine(std::move(*agg), std::move(*value));
+            } else if constexpr(is_spillable<T>) {
+                write_spilled(partitions[hash_value(k, depth + 1) % partition_count].get(), *value);
+            }
+        }
+
+        groups.move_to(result);
+
+        for(temp_file &partition : partitions) {
+            std::rewind(partition.get());
+            run(spilled_reader<T>{partition.get()}, depth + 1, result);
+            partition.reset();
+        }
+    }
+
+private:
+    static std::vector<temp_file> open_partitions() {
+        std::vector<temp_file> partitions;
+        for(std::size_t i = 0; i < partition_count; ++i)
+            partitions.push_back(make_temp_file());
+        return partitions;
+    }
+
+    KeyFunc &key;
+    const Agg &init;
+    Combine &combine;
+    std::size_t budget;
+};
+
+
+struct group_by_term {
+    template<typename Op, typename KeyFunc>
+    auto operator()(Op &prev_op, KeyFunc &key) const { return (*this)(prev_op, key, default_memory_budget); }
+
+    template<typename Op, typename KeyFunc>
+    auto operator()(Op &prev_op, KeyFunc &key, memory_budget budget) const {
+        using T = typename Op::value_type;
+        std::vector<T> init;
+        auto append = [](std::vector<T> values, T &&value) {
+            values.push_back(std::move(value));
+            return values;
+        };
+        return (*this)(prev_op, key, init, append, budget);
+    }
+
+    template<typename Op, typename KeyFunc, typename Agg, typename Combine>
+    auto operator()(Op &prev_op, KeyFunc &key, Agg &init, Combine &combine) const {
+        return (*this)(prev_op, key, init, combine, default_memory_budget);
+    }
+
+    template<typename Op, typename KeyFunc, typename Agg, typename Combine>
+    auto operator()(Op &prev_op, KeyFunc &key, Agg &init, Combine &combine, memory_budget budget) const {
+        grouper<typename Op::value_type, KeyFunc, Agg, Combine> g(key, init, combine, budget.bytes);
+        typename decltype(g)::result_type result;
+        g.run([&] { return prev_op.next(); }, 0, result);
+        return result;
+    }
+};
+
+
+} // namespace detail
+
+
+constexpr inline stream_op distinct{detail::distinct_op{}, detail::distinct_init{}};
+constexpr inline stream_term group_by{detail::group_by_term{}};
+
+
+} // namespace stream
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef LIPH_STREAM_MAPPED_HPP
+#define LIPH_STREAM_MAPPED_HPP
+
+#include "core.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/* mapped_lines, mapped_records and mapped_fields memory-map a file and generate std::string_views pointing
+ * directly into the mapping, so nothing is copied and only the pages currently being read need to be in
+ * memory, however big the file is:
+ *
+ *     for(std::string_view line : mapped_lines("app.log")
+ *             | filter([](std::string_view line) { return line.find("ERROR") != std::string_view::npos; }))
+ *         std::cout << line << '\n';
+ *
+ * The mapping lives as long as the stream does. To keep the string_views around after the stream has
+ * finished (e.g. with as_vector), open a mapped_file and pass that instead of the path, since copies of
+ * a mapped_file share the same mapping.
+ */
+
+namespace stream {
+
+
+class mapped_file_error : public streamer_error {
+public:
+    mapped_file_error(const std::string &what) : streamer_error(what) {}
+    mapped_file_error(const char *what) : streamer_error(what) {}
+};
+
+
+class mapped_file {
+public:
+    mapped_file(const std::string &path) : data_(nullptr), size_(0) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            throw mapped_file_error("unable to open " + path);
+
+        struct stat st;
+        if(::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw mapped_file_error("unable to stat " + path);
+        }
+
+        // mmap refuses empty mappings
+        if(st.st_size == 0) {
+            ::close(fd);
+            return;
+        }
+
+        void *mapped = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(mapped == MAP_FAILED)
+            throw mapped_file_error("unable to map " + path);
+
+        std::size_t length = st.st_size;
+        storage = std::shared_ptr<const void>(mapped, [length](const void *p) { ::munmap(const_cast<void*>(p), length); });
+        data_ = static_cast<const char*>(mapped);
+        size_ = length;
+
+        // streams read the file front to back, so the kernel can read ahead and drop pages behind us
+        ::madvise(mapped, length, MADV_SEQUENTIAL);
+    }
+
+    mapped_file(const char *path) : mapped_file(std::string(path)) {}
+
+    const char *data() const { return data_; }
+    std::size_t size() const { return size_; }
+    std::string_view view() const { return std::string_view(data_, size_); }
+
+private:
+    std::shared_ptr<const void> storage;
+    const char *data_;
+    std::size_t size_;
+};
+
+
+namespace detail {
+
+
+// fields end at the delimiter or at the end of the line. the last field doesn't need either after it,
+// but an empty field is only generated when there is one after it
+struct mapped_fields_gen {
+    std::optional<std::string_view> operator()(mapped_file &file, std::size_t &pos, char delimiter) const {
+        if(pos >= file.size())
+            return {};
+
+        const char *start = file.data() + pos;
+        const char *end = file.data() + file.size();
+        // memchr is much faster when there's only the one character to look for
+        const char *found = delimiter == '\n'
+            ? static_cast<const char*>(std::memchr(start, '\n', end - start))
+            : std::find_if(start, end, [delimiter](char c) { return c == delimiter || c == '\n'; });
+
+        std::size_t length = found && found != end ? found - start : end - start;
+        pos += length + 1;
+        return std::string_view(start, length);
+    }
+};
+struct mapped_lines_init {
+    template<typename File>
+    auto operator()(File &&file) const {
+        return std::make_tuple(mapped_file(std::forward<File>(file)), std::size_t(), '\n');
+    }
+};
+struct mapped_fields_init {
+    template<typename File>
+    auto operator()(File &&file, char delimiter) const {
+        return std::make_tuple(mapped_file(std::forward<File>(file)), std::size_t(), delimiter);
+    }
+};
+
+
+struct mapped_records_gen {
+    std::optional<std::string_view> operator()(mapped_file &file, std::size_t &pos, std::size_t record_size) const {
+        if(pos >= file.size())
+            return {};
+
+        std::string_view record(file.data() + pos, record_size);
+        pos += record_size;
+        return record;
+    }
+
+    stream_size size_hint(mapped_file &file, std::size_t &pos, std::size_t record_size) const {
+        return stream_size::exactly((file.size() - pos) / record_size);
+    }
+};
+struct mapped_records_init {
+    template<typename File>
+    auto operator()(File &&file, std::size_t record_size) const {
+        mapped_file mapped(std::forward<File>(file));
+        if(record_size == 0 || mapped.size() % record_size != 0)
+            throw mapped_file_error("mapped_records: the file size must be a multiple of the record size");
+        return std::make_tuple(std::move(mapped), std::size_t(), record_size);
+    }
+};
+
+
+} // namespace detail
+
+
+// mapped_lines(path_or_file): each line without its '\n'
+constexpr inline stream_gen mapped_lines{detail::mapped_fields_gen{}, detail::mapped_lines_init{}};
+
+// mapped_fields(path_or_file, delimiter): the text between each delimiter or newline
+constexpr inline stream_gen mapped_fields{detail::mapped_fields_gen{}, detail::mapped_fields_init{}};
+
+// mapped_records(path_or_file, record_size): consecutive record_size-byte chunks of the file
+constexpr inline stream_gen mapped_records{detail::mapped_records_gen{}, detail::mapped_records_init{}};
+
+
+} // namespace stream
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef LIPH_STREAM_PARALLEL_HPP
+#define LIPH_STREAM_PARALLEL_HPP
+
+#include "basic.hpp"
+#include "../parallel_for/parallel_for.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+/* par_as_vector, par_reduce and par_for_each split the source of the stream into chunks and run the
+ * rest of the pipeline on each chunk, with parallel_for (see parallel_for.hpp), which starts up to
+ * std::thread::hardware_concurrency() threads for each call. This is only possible when the source is a
+ * random access container (or upto over integers) and every operation between it and the terminal
+ * handles each element independently (mapping, filter, exclude and flat_mapping). Otherwise, the
+ * stream is simply run on the calling thread.
+ *
+ * The functions passed to the operations are copied for each chunk, but par_for_each's function is
+ * shared by all the threads.
+ */
+
+namespace stream {
+
+
+namespace detail {
+
+
+struct range_gen {
+    template<typename It>
+    constexpr auto operator()(It &current, It &last) const {
+        if(current == last)
+            return std::optional<std::decay_t<decltype(*current)>>();
+        else
+            return std::optional(*current++);
+    }
+};
+
+constexpr inline stream_gen iterator_range{range_gen{}};
+
+
+template<typename Func>
+constexpr bool is_elementwise_op = false;
+
+template<> constexpr bool is_elementwise_op<mapping_op> = true;
+template<> constexpr bool is_elementwise_op<filter_op> = true;
+template<> constexpr bool is_elementwise_op<exclude_op> = true;
+template<> constexpr bool is_elementwise_op<flat_mapping_op> = true;
+
+
+// chunk_source<T>::size(src) and chunk_source<T>::rebind(src, begin, end) split up the source of a stream
+template<typename T>
+struct chunk_source { static constexpr bool value = false; };
+
+template<typename Init, typename Container, typename It>
+struct chunk_source<gen<stream_gen<container_gen, Init, container_post_init>, std::tuple<Container, std::optional<It>>>> {
+    static constexpr bool value = std::is_base_of_v<std::random_access_iterator_tag,
+                                                    typename std::iterator_traits<It>::iterator_category>;
+
+    template<typename Gen>
+    static std::size_t size(const Gen &g) {
+        return std::end(std::get<0>(g.params)) - *std::get<1>(g.params);
+    }
+
+    template<typename Gen>
+    static auto rebind(const Gen &g, std::size_t begin, std::size_t end) {
+        It first = *std::get<1>(g.params);
+        return gen(iterator_range(first + begin, first + end));
+    }
+};
+
+template<typename Init, typename PostInit, typename T, typename U>
+struct chunk_source<gen<stream_gen<upto_gen, Init, PostInit>, std::tuple<T, U>>> {
+    static constexpr bool value = std::is_integral_v<T> && std::is_integral_v<U>;
+
+    template<typename Gen>
+    static std::size_t size(const Gen &g) {
+        auto &[start, end] = g.params;
+        return static_cast<std::size_t>(upto_gen::distance(start, end));
+    }
+
+    template<typename Gen>
+    static auto rebind(const Gen &g, std::size_t begin, std::size_t end) {
+        T start = std::get<0>(g.params);
+        return gen(upto(static_cast<T>(start + begin), static_cast<T>(start + end)));
+    }
+};
+
+template<typename Src, typename Func, typename InitFunc, typename PostInitFunc, typename Params>
+struct chunk_source<pipe<Src, stream_op<Func, InitFunc, PostInitFunc>, Params>> {
+    static constexpr bool value = chunk_source<Src>::value && is_elementwise_op<Func>;
+
+    template<typename Pipe>
+    static std::size_t size(const Pipe &p) { return chunk_source<Src>::size(p.src); }
+
+    // re-initializes the operation, so it gets its own copy of its parameters
+    template<typename Pipe>
+    static auto rebind(const Pipe &p, std::size_t begin, std::size_t end) {
+        return pipe(chunk_source<Src>::rebind(p.src, begin, end), p.dest);
+    }
+};
+
+
+// returns {func(chunk) for each chunk}, in order. if the stream can't be split up, func is called once
+// with the whole stream.
+template<typename Op, typename Func>
+auto map_chunks(Op &prev_op, Func func) {
+    using result_t = decltype(func(prev_op));
+
+    if constexpr(chunk_source<Op>::value) {
+        std::size_t size = chunk_source<Op>::size(prev_op);
+        std::size_t chunk_count = std::min<std::size_t>(size, std::max(std::thread::hardware_concurrency(), 1u) * 4);
+        std::vector<std::optional<result_t>> results(chunk_count);
+
+        parallel_for(chunk_count, [&](std::size_t i) {
+            auto chunk = chunk_source<Op>::rebind(prev_op, size * i / chunk_count, size * (i + 1) / chunk_count);
+            results[i].emplace(func(chunk));
+        });
+
+        std::vector<result_t> ordered;
+        ordered.reserve(chunk_count);
+        for(auto &result : results)
+            ordered.push_back(std::move(*result));
+        return ordered;
+    } else {
+        return std::vector<result_t>{func(prev_op)};
+    }
+}
+
+
+struct par_as_vector_term {
+    template<typename Op>
+    auto operator()(Op &prev_op) const {
+        using T = typename Op::value_type;
+
+        std::vector<std::vector<T>> chunks = map_chunks(prev_op, [](auto &chunk) {
+            return std::vector<T>(std::begin(chunk), std::end(chunk));
+        });
+
+        std::size_t total = 0;
+        for(auto &chunk : chunks)
+            total += chunk.size();
+
+        std::vector<T> result;
+        result.reserve(total);
+        for(auto &chunk : chunks)
+            std::move(chunk.begin(), chunk.end(), std::back_inserter(result));
+        return result;
+    }
+};
+
+
+// func must be associative and identity must not change the result when combined with anything,
+// since each chunk is reduced starting from identity before the chunks' results are combined in order
+struct par_reduce_term {
+    template<typename Op, typename T, typename Func>
+    auto operator()(Op &prev_op, T &identity, Func &func) const {
+        std::vector<T> partials = map_chunks(prev_op, [&](auto &chunk) {
+            T result = identity;
+            while(auto value = chunk.next())
+                result = func(std::move(result), std::move(*value));
+            return result;
+        });
+
+        T result = identity;
+        for(T &partial : partials)
+            result = func(std::move(result), std::move(partial));
+        return result;
+    }
+};
+
+
+// func may be called from several threads at once, in no particular order
+struct par_for_each_term {
+    template<typename Op, typename Func>
+    void operator()(Op &prev_op, Func &func) const {
+        map_chunks(prev_op, [&](auto &chunk) {
+            while(auto value = chunk.next())
+                func(*value);
+            return true;
+        });
+    }
+};
+
+
+} // namespace detail
+
+
+constexpr inline stream_term par_as_vector{detail::par_as_vector_term{}};
+constexpr inline stream_term par_reduce{detail::par_reduce_term{}};
+constexpr inline stream_term par_for_each{detail::par_for_each_term{}};
+
+} // namespace stream
+
+#endif
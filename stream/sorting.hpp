@@ -0,0 +1,283 @@
+#ifndef LIPH_STREAM_SORTING_HPP
+#define LIPH_STREAM_SORTING_HPP
+
+#include "parallel.hpp"
+#include "spill.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+
+/* sorted, sorted(comp) and sorted(comp, memory_budget{bytes}) pull the whole stream the first time a value
+ * is asked for, and then generate the values in order. Large inputs are sorted on several threads, so comp
+ * must be safe to call from more than one thread at a time. The sort is not stable.
+ *
+ * If the values take up more than the memory budget (256MB by default), each budget's worth is sorted and
+ * written out to a temporary file as a run, and the runs are merged as the values are pulled from the
+ * stream, so only one value per run is held in memory. Only trivially copyable types and std::string can
+ * be spilled; other types are always sorted in memory. A stream must not be copied once it has started.
+ *
+ * No more than merge_fan_in runs are merged at once: whenever that many runs of the same size have been
+ * written, they're merged into one bigger run, and once the input has run out, the smallest runs are
+ * merged, up to merge_fan_in at a time, until merge_fan_in are left. So each value is written out about log(runs) / log(merge_fan_in)
+ * times, and the number of open files stays small.
+ */
+
+namespace stream {
+
+
+namespace detail {
+
+
+// a tournament tree for merging k sorted sources, where each internal node remembers the loser of the
+// match played there. replacing the winner only replays the matches on its path to the root, so each
+// value costs about log2(k) comparisons. ties go to the source with the lower index.
+template<typename T, typename Comp>
+class loser_tree {
+public:
+    loser_tree(std::vector<std::optional<T>> heads, Comp comp) : heads(std::move(heads)), tree(std::max<std::size_t>(this->heads.size(), 1)), comp(std::move(comp)) {
+        std::size_t k = this->heads.size();
+        std::vector<std::size_t> winners(2 * k);
+        for(std::size_t i = 0; i < k; ++i)
+            winners[k + i] = i;
+
+        for(std::size_t node = k; node-- > 1;) {
+            std::size_t a = winners[2 * node], b = winners[2 * node + 1];
+            if(beats(b, a))
+                std::swap(a, b);
+            winners[node] = a;
+            tree[node] = b;
+        }
+        tree[0] = k > 1 ? winners[1] : 0;
+    }
+
+    // removes the smallest head, replacing it with refill(index of its source), which returns an empty
+    // optional once that source has run out
+    template<typename Refill>
+    std::optional<T> pop(Refill &&refill) {
+        if(heads.empty())
+            return {};
+
+        std::size_t winner = tree[0];
+        if(!heads[winner])
+            return {};
+
+        std::optional<T> value = std::move(heads[winner]);
+        heads[winner] = refill(winner);
+
+        for(std::size_t node = (winner + heads.size()) / 2; node >= 1; node /= 2) {
+            if(beats(tree[node], winner))
+                std::swap(tree[node], winner);
+        }
+        tree[0] = winner;
+        return value;
+    }
+
+private:
+    // sources which have run out lose to everything
+    bool beats(std::size_t a, std::size_t b) {
+        if(!heads[a])
+            return false;
+        if(!heads[b])
+            return true;
+        if(comp(*heads[a], *heads[b]))
+            return true;
+        return !comp(*heads[b], *heads[a]) && a < b;
+    }
+
+    std::vector<std::optional<T>> heads;
+    std::vector<std::size_t> tree;
+    Comp comp;
+};
+
+
+constexpr inline std::size_t parallel_sort_threshold = std::size_t(1) << 16;
+constexpr inline std::size_t merge_fan_in = 64;
+
+// sorts separate slices on separate threads, then merges neighbouring slices in parallel rounds
+template<typename T, typename Comp>
+void parallel_sort(std::vector<T> &values, Comp &comp) {
+    std::size_t slices = 1;
+    while(slices * 2 <= std::min<std::size_t>(std::thread::hardware_concurrency(), 16))
+        slices *= 2;
+
+    if(values.size() < parallel_sort_threshold || slices < 2) {
+        std::sort(values.begin(), values.end(), comp);
+        return;
+    }
+
+    auto bound = [&](std::size_t slice) { return values.begin() + values.size() * slice / slices; };
+
+    parallel_for(slices, [&](std::size_t i) { std::sort(bound(i), bound(i + 1), comp); });
+
+    for(std::size_t width = 1; width < slices; width *= 2) {
+        parallel_for(slices / (2 * width), [&](std::size_t i) {
+            std::size_t first = 2 * width * i;
+            std::inplace_merge(bound(first), bound(first + width), bound(first + 2 * width), comp);
+        });
+    }
+}
+
+
+template<typename T, typename Comp>
+class external_sorter {
+public:
+    external_sorter(Comp comp, std::size_t budget) : comp(std::move(comp)), budget(budget), loaded(false), index(0), remaining(0) {}
+
+    // the copy hasn't been started
+    external_sorter(const external_sorter &other) : external_sorter(other.comp, other.budget) {}
+    external_sorter(external_sorter &&) = default;
+
+    template<typename Op>
+    std::optional<T> next(Op &prev_op) {
+        if(!loaded)
+            load(prev_op);
+
+        if(remaining == 0)
+            return {};
+        --remaining;
+
+        if(!tree)
+            return std::move(values[index++]);
+
+        return tree->pop([this](std::size_t run) { return read_spilled<T>(runs[run].file.get()); });
+    }
+
+    template<typename Op>
+    stream_size size_hint(Op &prev_op) {
+        return loaded ? stream_size::exactly(remaining) : detail::size_hint(prev_op);
+    }
+
+private:
+    template<typename Op>
+    void load(Op &prev_op) {
+        loaded = true;
+
+        std::vector<T> block;
+        std::size_t bytes = 0;
+        while(detail::next_batch(prev_op, block)) {
+            remaining += block.size();
+            for(T &value : block) {
+                if constexpr(is_spillable<T>)
+                    bytes += held_bytes(value);
+                values.push_back(std::move(value));
+            }
+
+            if(bytes > budget) {
+                spill();
+                bytes = 0;
+            }
+        }
+
+        if(runs.empty()) {
+            parallel_sort(values, comp);
+            return;
+        }
+
+        if(!values.empty())
+            spill();
+        values = std::vector<T>();
+
+        // the runs at the back are the smallest. each merge takes at most merge_fan_in of them, and no more
+        // than it takes to get down to merge_fan_in runs.
+        while(runs.size() > merge_fan_in)
+            merge_runs(runs.size() - std::min(merge_fan_in, runs.size() - merge_fan_in + 1));
+
+        tree.emplace(start_merge(0), comp);
+    }
+
+    void spill() {
+        if constexpr(is_spillable<T>) {
+            parallel_sort(values, comp);
+
+            temp_file run = make_temp_file();
+            for(const T &value : values)
+                write_spilled(run.get(), value);
+            runs.push_back({std::move(run), 0});
+            values.clear();
+
+            // the levels never go up towards the back, so if the first of the last merge_fan_in runs is
+            // at the same level as the last, they all are
+            while(runs.size() >= merge_fan_in && runs[runs.size() - merge_fan_in].level == runs.back().level)
+                merge_runs(runs.size() - merge_fan_in);
+        }
+    }
+
+    // rewinds the runs from first onwards, and reads the first value of each
+    std::vector<std::optional<T>> start_merge(std::size_t first) {
+        std::vector<std::optional<T>> heads;
+        for(std::size_t i = first; i < runs.size(); ++i) {
+            std::rewind(runs[i].file.get());
+            heads.push_back(read_spilled<T>(runs[i].file.get()));
+        }
+        return heads;
+    }
+
+    // replaces the runs from first onwards with a single run
+    void merge_runs(std::size_t first) {
+        if constexpr(is_spillable<T>) {
+            loser_tree<T, Comp> merger(start_merge(first), comp);
+            temp_file merged = make_temp_file();
+            while(auto value = merger.pop([&](std::size_t run) { return read_spilled<T>(runs[first + run].file.get()); }))
+                write_spilled(merged.get(), *value);
+
+            std::size_t level = runs.back().level + 1;
+            runs.erase(runs.begin() + first, runs.end());
+            runs.push_back({std::move(merged), level});
+        }
+    }
+
+    struct run {
+        temp_file file;
+        std::size_t level;  // how many times its values have been merged
+    };
+
+    Comp comp;
+    std::size_t budget;
+    bool loaded;
+    std::vector<T> values;
+    std::size_t index;
+    std::size_t remaining;
+    std::vector<run> runs;
+    std::optional<loser_tree<T, Comp>> tree;
+};
+
+
+struct sorted_op {
+    template<typename Op, typename T, typename Comp>
+    std::optional<T> operator()(Op &prev_op, external_sorter<T, Comp> &sorter) const { return sorter.next(prev_op); }
+
+    template<typename Op, typename T, typename Comp>
+    stream_size size_hint(Op &prev_op, external_sorter<T, Comp> &sorter) const { return sorter.size_hint(prev_op); }
+};
+struct sorted_init {
+    template<typename Src>
+    auto operator()(Src &src) const { return (*this)(src, std::less<>(), default_memory_budget); }
+
+    template<typename Src>
+    auto operator()(Src &src, memory_budget budget) const { return (*this)(src, std::less<>(), budget); }
+
+    template<typename Src, typename Comp>
+    auto operator()(Src &src, Comp comp) const { return (*this)(src, std::move(comp), default_memory_budget); }
+
+    template<typename Src, typename Comp>
+    auto operator()(Src &, Comp comp, memory_budget budget) const {
+        return std::make_tuple(external_sorter<typename Src::value_type, Comp>(std::move(comp), budget.bytes));
+    }
+};
+
+
+} // namespace detail
+
+
+constexpr inline stream_op sorted{detail::sorted_op{}, detail::sorted_init{}};
+
+
+} // namespace stream
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef LIPH_STREAM_SPILL_HPP
+#define LIPH_STREAM_SPILL_HPP
+
+#include "core.hpp"
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+
+
+/* Operations which may need more memory than they're allowed (group_by, sorted) write values out to
+ * temporary files, which are deleted once they're closed. The values are written as raw bytes, so only
+ * trivially copyable types and std::string can be spilled.
+ */
+
+namespace stream {
+
+
+struct memory_budget {
+    std::size_t bytes;
+};
+
+constexpr inline memory_budget default_memory_budget{std::size_t(256) << 20};
+
+
+namespace detail {
+
+
+template<typename T>
+constexpr bool is_spillable = std::is_trivially_copyable_v<T> || std::is_same_v<T, std::string>;
+
+// roughly how much memory value takes up while it's being held on to
+template<typename T>
+std::size_t held_bytes(const T &value) {
+    if constexpr(std::is_same_v<T, std::string>)
+        return sizeof value + value.capacity();
+    else
+        return sizeof value;
+}
+
+
+struct file_closer {
+    void operator()(std::FILE *file) const { std::fclose(file); }
+};
+
+using temp_file = std::unique_ptr<std::FILE, file_closer>;
+
+inline temp_file make_temp_file() {
+    temp_file file(std::tmpfile());
+    if(!file)
+        throw streamer_error("unable to create a temporary file");
+    return file;
+}
+
+
+template<typename T>
+void write_spilled(std::FILE *file, const T &value) {
+    bool written;
+    if constexpr(std::is_same_v<T, std::string>) {
+        std::size_t length = value.size();
+        written = std::fwrite(&length, sizeof length, 1, file) == 1
+            && std::fwrite(value.data(), 1, length, file) == length;
+    } else {
+        written = std::fwrite(&value, sizeof value, 1, file) == 1;
+    }
+
+    if(!written)
+        throw streamer_error("unable to write to a temporary file");
+}
+
+template<typename T>
+std::optional<T> read_spilled(std::FILE *file) {
+    if constexpr(std::is_same_v<T, std::string>) {
+        std::size_t length;
+        if(std::fread(&length, sizeof length, 1, file) != 1)
+            return {};
+        std::string value(length, '\0');
+        if(std::fread(value.data(), 1, length, file) != length)
+            throw streamer_error("truncated temporary file");
+        return value;
+    } else {
+        // read as bytes, so that T doesn't need to be default constructible
+        std::array<unsigned char, sizeof(T)> bytes;
+        if(std::fread(bytes.data(), sizeof(T), 1, file) != 1)
+            return {};
+        return std::bit_cast<T>(bytes);
+    }
+}
+
+
+template<typename T>
+struct spilled_reader {
+    std::optional<T> operator()() const { return read_spilled<T>(file); }
+    std::FILE *file;
+};
+
+
+} // namespace detail
+
+} // namespace stream
+
+#endif
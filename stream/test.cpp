@@ -1,17 +1,25 @@
+#include "async.hpp"
 #include "basic.hpp"
+#include "combining.hpp"
+#include "hashing.hpp"
+#include "mapped.hpp"
+#include "parallel.hpp"
+#include "sorting.hpp"
 #include "stream.hpp"
 #include <iostream>
+#include <list>
+#include <unordered_set>
 
 
 using namespace stream;
 
 
 int main() {
-    for(int x : range(10, 20) | filter([](int x) { return x % 2; })) {
+    for(int x : upto(10, 20) | filter([](int x) { return x % 2; })) {
         std::cout << x << std::endl;
     }
 
-    std::vector<int> result = range(10, 49) 
+    std::vector<int> result = upto(10, 49) 
         | mapping([](auto &&x) { return x / 3; }) 
         | adj_unique 
         | filter([](auto &&x) { return x % 2; })
@@ -21,7 +29,7 @@ int main() {
     streamer result2 = result 
         | mapping([](auto &&x) { return x * 2; });
 
-    streamer result3 = range(50, 53);
+    streamer result3 = upto(50, 53);
     streamer result4 = result;
 
 //    auto it = result2.begin();
@@ -29,4 +37,115 @@ int main() {
 //        std::cout << *it << ' ' << (it == result2.end()) << std::endl;
     for(int x : result | mapping([](auto &&x) { return x * 2; }))
         std::cout << x << std::endl; 
+
+    // upto, mapping and filter all handle a batch of values at a time, so this runs without per-element optionals
+    std::vector<int> odd_triples = upto(0, 1000) 
+        | mapping([](int x) { return x * 3; }) 
+        | filter([](int x) { return x % 2; }) 
+        | as_vector;
+    std::cout << odd_triples.size() << ' ' << odd_triples.back() << std::endl;
+
+    // batches of iterators which aren't random access
+    std::list<int> list{4, 5, 6};
+    std::vector<int> from_list = upto(list.begin(), list.end()) | mapping([](auto it) { return *it * 2; }) | as_vector;
+    std::cout << from_list.size() << ' ' << from_list.back() << std::endl;
+
+    // the size of upto over integers is known, so is kept through mapping, and bounds what's left after filter
+    auto evens = upto(0, 1000) | filter([](int x) { return x % 2 == 0; });
+    stream::detail::stream_size hint = evens.size_hint();
+    std::cout << (hint.kind == stream::detail::stream_size::bound::at_most) << ' ' << hint.size << std::endl;
+    std::cout << (upto(-2000000000, 2000000000) | filter([](int x) { return x == 0; })).size_hint().size << ' '
+        << (upto(0, 10) | mapping([](int x) { return x % 4; }) | as<std::unordered_set<int>>).size() << std::endl;
+
+    std::vector<long> big = upto(0L, 100000L) | as_vector;
+    std::vector<long> squares = big 
+        | mapping([](long x) { return x * x; }) 
+        | filter([](long x) { return x % 3; })
+        | par_as_vector;
+    std::cout << squares.size() << ' ' << squares[1] << ' ' << squares.back() << std::endl;
+
+    std::cout << (upto(0L, 100000L) | par_reduce(0L, [](long x, long y) { return x + y; })) << std::endl;
+
+    std::atomic<long> total = 0;
+    big | flat_mapping([](long x) { return upto(x % 3); }) | par_for_each([&](long x) { total += x; });
+    std::cout << total << std::endl;
+
+    stream::mapped_file log("mapped_test.txt");
+    std::vector<std::string_view> errors = mapped_lines(log)
+        | filter([](std::string_view line) { return line.find("ERROR") != std::string_view::npos; })
+        | as_vector;
+    std::cout << errors.size() << ' ' << errors[1] << ' ' << *(mapped_fields(log, ',') | first) << ' ' 
+        << (mapped_records(log, 4) | as_vector).size() << ' ' << (mapped_fields(log, ',') | count) << std::endl;
+
+    std::vector<long> staged = upto(0L, 10000L)
+        | mapping([](long x) { return x * x; }) | async_stage
+        | filter([](long x) { return x % 2; }) | buffered(2)
+        | as_vector;
+    std::cout << staged.size() << ' ' << staged.back() << std::endl;
+
+    // upto(1, unbounded) never ends, but these stop pulling once they have their answer
+    std::cout << (upto(1, unbounded) | limit(5) | count) << ' ' 
+        << (upto(1, unbounded) | take(3)).back() << ' ' 
+        << (upto(1, unbounded) | take_while([](int x) { return x * x < 50; })).size() << ' '
+        << *(upto(1, unbounded) | flat_mapping([](int x) { return upto(x + 1); }) | find_if([](int x) { return x > 3; })) << ' '
+        << (upto(1, unbounded) | any_of([](int x) { return x % 7 == 0; })) << ' '
+        << (upto(1, unbounded) | all_of([](int x) { return x < 10; })) << ' '
+        << (upto(0, 100) | count([](int x) { return x % 3 == 0; })) << ' '
+        << (upto(0, 10) | take(1'000'000'000)).capacity() << std::endl;
+
+    // count only skips the values of a source which knows its size, so a mapping before it still runs for each
+    int mapped = 0;
+    std::cout << (upto(0, 10) | mapping([&](int x) { ++mapped; return x; }) | count) << ' ' << mapped << ' '
+        << (upto(-2000000000, 2000000000) | count) << ' ' << (std::vector<int>(7) | count) << std::endl;
+
+    std::cout << (upto(0, 10000) | mapping([](int x) { return x * x % 101; }) | distinct | count) << ' '
+        << (upto(0, 10000) | mapping([](int x) { return x % 500; }) | distinct(approximate{500, 0.001}) | count) << std::endl;
+
+    // a tiny budget makes the groups spill to temporary files
+    auto digit_sums = upto(0, 100000) 
+        | group_by([](int x) { return x % 10; }, 0L, [](long sum, int x) { return sum + x; }, memory_budget{64});
+    std::sort(digit_sums.begin(), digit_sums.end());
+    std::cout << digit_sums.size() << ' ' << digit_sums[3].second << std::endl;
+
+    // spilled values are read back without being default constructed, and the strings' characters count
+    // towards the budget
+    struct cell {
+        cell(int row, int column) : row(row), column(column) {}
+        int row, column;
+    };
+    auto rows = upto(0, 1000) | mapping([](int i) { return cell(i % 7, i); }) | group_by([](const cell &c) { return c.row; }, memory_budget{64});
+    auto words = upto(0, 2000) | mapping([](int i) { return std::string(100, 'a' + i % 26); }) | group_by([](const std::string &s) { return s; }, memory_budget{4096});
+    std::size_t word_count = 0;
+    for(auto &[word, copies] : words)
+        word_count += copies.size();
+    std::cout << rows.size() << ' ' << words.size() << ' ' << word_count << std::endl;
+
+    // with a 4KB budget the values are sorted in runs of a few hundred, which are written out and merged afterwards
+    std::vector<long> shuffled = upto(0L, 10000L) | mapping([](long x) { return x * 7919 % 10000; }) | as_vector;
+    std::vector<long> ascending = shuffled | sorted(std::less<>(), memory_budget{4096}) | as_vector;
+    std::cout << std::is_sorted(ascending.begin(), ascending.end()) << ' ' << ascending.size() << ' '
+        << *(shuffled | sorted(std::greater<>()) | first) << std::endl;
+
+    // hundreds of runs, which are merged merge_fan_in at a time before the final merge
+    std::vector<long> many_runs = upto(0L, 100000L) 
+        | mapping([](long x) { return x * 7919 % 100000; }) 
+        | sorted(std::less<>(), memory_budget{1024}) 
+        | as_vector;
+    std::cout << std::is_sorted(many_runs.begin(), many_runs.end()) << ' ' << many_runs.size() << ' ' << many_runs.back() << std::endl;
+
+    // more than merge_fan_in^2 runs of 256 values (a block), which leaves 74 runs once the input has run out
+    std::vector<long> more_runs = upto(0L, 2083328L)
+        | mapping([](long x) { return x * 7919 % 2083328; })
+        | sorted(std::less<>(), memory_budget{1})
+        | as_vector;
+    std::cout << std::is_sorted(more_runs.begin(), more_runs.end()) << ' ' << more_runs.size() << ' ' << more_runs.back() << std::endl;
+
+    std::vector<int> shard1{1, 4, 9}, shard2{2, 3, 10};
+    for(int x : merge(shard1, shard2, upto(5, 8)))
+        std::cout << x << ' ';
+    std::cout << *(merge(std::vector<int>{9, 4, 1}, downto(8, 5), std::greater<>()) | first) << std::endl;
+
+    for(auto [i, x] : zip(upto(0, unbounded), shard2 | mapping([](int x) { return x * 10; })))
+        std::cout << i << ':' << x << ' ';
+    std::cout << std::endl;
 }